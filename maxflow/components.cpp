@@ -0,0 +1,222 @@
+#include "components.hpp"
+#include <climits>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////
+// Union-find
+////////////////////////////////////////////////////////////////
+
+union_find::union_find(const size_t &n)
+{
+    parent.resize(n);
+    rank.assign(n, 0);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        parent[i] = (int)i;
+    }
+}
+
+// Path halving: point every other node at its grandparent
+int union_find::find(int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+
+    return i;
+}
+
+void union_find::unite(const int &a, const int &b)
+{
+    int ra = find(a), rb = find(b);
+
+    if (ra == rb)
+    {
+        return;
+    }
+
+    if (rank[ra] < rank[rb])
+    {
+        parent[ra] = rb;
+    }
+    else if (rank[ra] > rank[rb])
+    {
+        parent[rb] = ra;
+    }
+    else
+    {
+        parent[rb] = ra;
+        rank[ra]++;
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Labeling
+////////////////////////////////////////////////////////////////
+
+// Counting sort of the nodes by component
+// Takes time proportional to the number of nodes
+graph_components label_components(union_find &sets)
+{
+    const int n = (int)sets.parent.size();
+    graph_components out;
+    vector<int> label_of_root(n, -1);
+
+    out.label.resize(n);
+    out.local.resize(n);
+    out.members.resize(n);
+
+    // Number the components in order of their lowest node
+    for (int i = 0; i < n; i++)
+    {
+        int root = sets.find(i);
+
+        if (label_of_root[root] == -1)
+        {
+            label_of_root[root] = out.count++;
+        }
+
+        out.label[i] = label_of_root[root];
+    }
+
+    out.offsets.assign(out.count + 1, 0);
+    for (int i = 0; i < n; i++)
+    {
+        out.offsets[out.label[i] + 1]++;
+    }
+    for (int c = 0; c < out.count; c++)
+    {
+        out.offsets[c + 1] += out.offsets[c];
+    }
+
+    vector<int> fill(out.offsets.begin(), out.offsets.end() - 1);
+    for (int i = 0; i < n; i++)
+    {
+        int c = out.label[i];
+        out.local[i] = fill[c] - out.offsets[c];
+        out.members[fill[c]++] = i;
+    }
+
+    return out;
+}
+
+// Takes time proportional to the number of edges
+graph_components find_components(const graph &of)
+{
+    union_find sets(of.nodes.size());
+
+    for (int from = 0; from < (int)of.nodes.size(); from++)
+    {
+        for (const auto &edge_item : of.nodes[from].edges)
+        {
+            sets.unite(from, edge_item.first);
+        }
+    }
+
+    return label_components(sets);
+}
+
+graph load_graph(istream &strm, graph_components &components)
+{
+    graph out = load_graph(strm);
+    components = find_components(out);
+    return out;
+}
+
+////////////////////////////////////////////////////////////////
+// Subproblems
+////////////////////////////////////////////////////////////////
+
+// Takes time proportional to the size of the component
+graph extract_component(const graph &from, const graph_components &components, const int &c)
+{
+    graph out;
+    out.nodes.resize(components.size(c));
+
+    for (int i = components.offsets[c]; i < components.offsets[c + 1]; i++)
+    {
+        const graph_node &node = from.nodes[components.members[i]];
+        graph_node &copy = out.nodes[i - components.offsets[c]];
+
+        for (const auto &edge_item : node.edges)
+        {
+            copy.edges[components.local[edge_item.first]] = edge_item.second;
+        }
+        for (const auto &prev : node.nodes_having_backwards_edges)
+        {
+            copy.nodes_having_backwards_edges.insert(components.local[prev]);
+        }
+    }
+
+    return out;
+}
+
+// Solves one component, with its terminals renumbered to match
+static int solve_component(const graph &on, const graph_components &components, const int &c,
+                           vector<terminal> sources, vector<terminal> sinks)
+{
+    graph sub = extract_component(on, components, c);
+    int iterations;
+
+    for (auto &source : sources)
+    {
+        source.node = components.local[source.node];
+    }
+    for (auto &sink : sinks)
+    {
+        sink.node = components.local[sink.node];
+    }
+
+    return multi_terminal_maxflow(sub, sources, sinks, iterations, false);
+}
+
+int component_maxflow(const graph &on, const graph_components &components, const vector<terminal> &sources,
+                      const vector<terminal> &sinks, thread_pool &pool, int *subproblems)
+{
+    vector<vector<terminal>> sources_in(components.count), sinks_in(components.count);
+    vector<future<int>> results;
+
+    for (const auto &s : sources)
+    {
+        sources_in[components.label[s.node]].push_back(s);
+    }
+    for (const auto &t : sinks)
+    {
+        sinks_in[components.label[t.node]].push_back(t);
+    }
+
+    // Only components with both ends of a flow can carry any
+    for (int c = 0; c < components.count; c++)
+    {
+        if (!sources_in[c].empty() && !sinks_in[c].empty())
+        {
+            results.push_back(pool.submit([&on, &components, c, &sources_in, &sinks_in]() {
+                return solve_component(on, components, c, sources_in[c], sinks_in[c]);
+            }));
+        }
+    }
+
+    // The tasks borrow sources_in and sinks_in, so let them all
+    // finish before get() can rethrow a failure
+    for (auto &result : results)
+    {
+        result.wait();
+    }
+
+    int out = 0;
+    for (auto &result : results)
+    {
+        out = saturating_add(out, result.get());
+    }
+
+    if (subproblems != nullptr)
+    {
+        *subproblems = (int)results.size();
+    }
+
+    return out;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file components.hpp
+ *
+ * @brief Weakly connected component detection, and concurrent
+ *        solving of flow problems which span several components.
+ *
+ * Flow never crosses between weakly connected components, so a
+ * problem whose terminals sit in several of them splits into
+ * independent subproblems whose flows simply add up.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef COMPONENTS_HPP
+#define COMPONENTS_HPP
+
+#include "maxflow.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @struct union_find
+ * @brief Disjoint sets over node indices, with path halving and
+ *        union by rank
+ *
+ * @var union_find::parent
+ * parent[i] is the next node toward i's representative
+ * @var union_find::rank
+ * An upper bound on the height of each representative's tree
+ */
+struct union_find
+{
+    std::vector<int> parent;
+    std::vector<unsigned char> rank;
+
+    explicit union_find(const size_t &n);
+
+    /**
+     * @brief Returns the representative of i's set
+     */
+    int find(int i);
+
+    /**
+     * @brief Merges the sets containing a and b
+     */
+    void unite(const int &a, const int &b);
+};
+
+/**
+ * @struct graph_components
+ * @brief The weakly connected components of a graph
+ *
+ * @var graph_components::label
+ * label[i] is the component (0 to count - 1) of node i
+ * @var graph_components::local
+ * local[i] is the position of node i within its component, and
+ * so its index in that component's extracted subgraph
+ * @var graph_components::members
+ * The nodes of every component, grouped by component and in
+ * increasing order within each
+ * @var graph_components::offsets
+ * Component c's nodes are members[offsets[c]] up to (but not
+ * including) members[offsets[c + 1]]
+ * @var graph_components::count
+ * The number of components
+ */
+struct graph_components
+{
+    std::vector<int> label, local, members, offsets;
+    int count = 0;
+
+    /**
+     * @brief Returns the number of nodes in component c
+     */
+    int size(const int &c) const
+    {
+        return offsets[c + 1] - offsets[c];
+    }
+};
+
+/**
+ * @brief Turns a union-find over the nodes into dense component
+ *        labels and member lists
+ *
+ * @param sets The disjoint sets, one element per node
+ *
+ * @return The labeled components
+ */
+graph_components label_components(union_find &sets);
+
+/**
+ * @brief Finds the weakly connected components of a graph by
+ *        uniting the ends of every edge
+ *
+ * @param of The graph to split
+ *
+ * @return The components of `of`
+ */
+graph_components find_components(const graph &of);
+
+/**
+ * @brief Loads a graph from an input stream and finds its
+ *        weakly connected components
+ *
+ * @param strm The stream to load from
+ * @param components Replaced by the components of the graph
+ *
+ * @return The loaded graph
+ */
+graph load_graph(std::istream &strm, graph_components &components);
+
+/**
+ * @brief Copies one component out into its own graph, with
+ *        nodes renumbered by `components.local`
+ *
+ * @param from The whole graph
+ * @param components The components of `from`
+ * @param c The component to copy
+ *
+ * @return The subgraph of component `c`
+ */
+graph extract_component(const graph &from, const graph_components &components, const int &c);
+
+/**
+ * @brief Returns the maxflow from a set of sources to a set of
+ *        sinks, solving each component which holds both a
+ *        source and a sink as its own `multi_terminal_maxflow`
+ *        problem on `pool`, and adding up the results.
+ *
+ * @param on The graph to operate on
+ * @param components The components of `on`
+ * @param sources The source nodes and their supply limits
+ * @param sinks The sink nodes and their demand limits; must not
+ *        share any node with `sources`
+ * @param pool The workers to solve the subproblems on
+ * @param subproblems If not null, replaced by the number of
+ *        components which were solved
+ *
+ * @return The total max flow from `sources` to `sinks`
+ */
+int component_maxflow(const graph &on, const graph_components &components, const std::vector<terminal> &sources,
+                      const std::vector<terminal> &sinks, thread_pool &pool, int *subproblems = nullptr);
+
+#endif
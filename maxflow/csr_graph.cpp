@@ -0,0 +1,716 @@
+#include "csr_graph.hpp"
+#include "kernels.hpp"
+#include "node_bitset.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char CSR_MAGIC[8] = {'M', 'A', 'X', 'F', 'L', 'O', 'W', '\0'};
+static const uint32_t CSR_VERSION = 1;
+
+// The most runs merged at once; more take several passes
+static const size_t MERGE_FAN_IN = 64;
+
+// Records are staged and written this many at a time
+static const size_t WRITE_BATCH = 1 << 16;
+
+////////////////////////////////////////////////////////////////
+// External merge sort
+////////////////////////////////////////////////////////////////
+
+// Writes records to a stream in batches
+template <typename T> class record_writer
+{
+  public:
+    explicit record_writer(ostream &strm) : strm(strm)
+    {
+        pending.reserve(WRITE_BATCH);
+    }
+
+    void write(const T &record)
+    {
+        pending.push_back(record);
+        if (pending.size() == WRITE_BATCH)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        strm.write(reinterpret_cast<const char *>(pending.data()), pending.size() * sizeof(T));
+        pending.clear();
+    }
+
+  private:
+    ostream &strm;
+    vector<T> pending;
+};
+
+// Reads back a run written by record_writer, a buffer at a time
+template <typename T> class record_reader
+{
+  public:
+    record_reader(const string &path, const size_t &buffer_records)
+        : strm(path, ios::binary), buffer(max(buffer_records, (size_t)1))
+    {
+        if (!strm.is_open())
+        {
+            throw runtime_error("build_csr_file: cannot read back '" + path + "'");
+        }
+    }
+
+    // Replaces `out` with the next record. Returns false at the end.
+    bool next(T &out)
+    {
+        if (position == count)
+        {
+            strm.read(reinterpret_cast<char *>(buffer.data()), buffer.size() * sizeof(T));
+            count = strm.gcount() / sizeof(T);
+            position = 0;
+
+            if (count == 0)
+            {
+                return false;
+            }
+        }
+
+        out = buffer[position++];
+        return true;
+    }
+
+  private:
+    ifstream strm;
+    vector<T> buffer;
+    size_t position = 0, count = 0;
+};
+
+// Sorts more records than fit in memory: each time the buffer
+// fills it is sorted and written out as a run, and the runs are
+// merged at the end. Equal records come out in the order they
+// were added.
+template <typename T, typename Less> class external_sorter
+{
+  public:
+    // Runs are named `prefix` plus a number. The buffer and the
+    // scratch stable_sort takes (half as many records) together
+    // hold memory_budget bytes, and the final merge reads with half
+    // as much, so that another sorter can fill alongside it. The
+    // buffer is reserved once, so it never holds two copies while
+    // growing; pages it never fills are never touched.
+    external_sorter(const string &prefix, const size_t &memory_budget)
+        : prefix(prefix), memory_budget(memory_budget),
+          capacity(max(memory_budget / sizeof(T) / 3 * 2, (size_t)1))
+    {
+        buffer.reserve(capacity);
+    }
+
+    ~external_sorter()
+    {
+        for (const auto &run : runs)
+        {
+            remove(run.c_str());
+        }
+    }
+
+    external_sorter(const external_sorter &) = delete;
+    external_sorter &operator=(const external_sorter &) = delete;
+
+    void add(const T &record)
+    {
+        buffer.push_back(record);
+        if (buffer.size() == capacity)
+        {
+            spill();
+        }
+    }
+
+    // Calls emit(record) for every record added, in order
+    template <typename Emit> void finish(Emit emit)
+    {
+        // It all fit: no files needed
+        if (runs.empty())
+        {
+            stable_sort(buffer.begin(), buffer.end(), less);
+            for (const auto &record : buffer)
+            {
+                emit(record);
+            }
+            vector<T>().swap(buffer);
+            return;
+        }
+
+        if (!buffer.empty())
+        {
+            spill();
+        }
+        vector<T>().swap(buffer);
+
+        // Merge groups of runs into longer runs until one pass will
+        // do. Each group is consecutive, so runs stay in the order
+        // their records were added.
+        while (runs.size() > MERGE_FAN_IN)
+        {
+            vector<string> longer;
+
+            for (size_t i = 0; i < runs.size(); i += MERGE_FAN_IN)
+            {
+                vector<string> group(runs.begin() + i, runs.begin() + min(i + MERGE_FAN_IN, runs.size()));
+                string name = next_run();
+                ofstream strm(name, ios::binary | ios::trunc);
+                record_writer<T> out(strm);
+
+                longer.push_back(name);
+                merge(group, [&](const T &record) { out.write(record); });
+                out.flush();
+                check(strm, name);
+            }
+
+            for (const auto &run : runs)
+            {
+                remove(run.c_str());
+            }
+            runs = longer;
+        }
+
+        merge(runs, emit);
+    }
+
+  private:
+    // Sorts the buffer and writes it out as the next run
+    void spill()
+    {
+        string name = next_run();
+        ofstream strm(name, ios::binary | ios::trunc);
+        record_writer<T> out(strm);
+
+        runs.push_back(name);
+        stable_sort(buffer.begin(), buffer.end(), less);
+        for (const auto &record : buffer)
+        {
+            out.write(record);
+        }
+        out.flush();
+        check(strm, name);
+
+        buffer.clear();
+    }
+
+    // Merges the given runs, earlier runs first among equal records
+    template <typename Emit> void merge(const vector<string> &group, Emit emit)
+    {
+        typedef pair<T, size_t> head;
+        auto later = [this](const head &a, const head &b) {
+            return less(b.first, a.first) || (!less(a.first, b.first) && a.second > b.second);
+        };
+
+        vector<unique_ptr<record_reader<T>>> readers;
+        priority_queue<head, vector<head>, decltype(later)> heads(later);
+        size_t buffer_records = memory_budget / 2 / sizeof(T) / group.size();
+
+        for (size_t i = 0; i < group.size(); i++)
+        {
+            T first;
+            readers.emplace_back(new record_reader<T>(group[i], buffer_records));
+            if (readers[i]->next(first))
+            {
+                heads.push(head(first, i));
+            }
+        }
+
+        while (!heads.empty())
+        {
+            head cur = heads.top();
+            heads.pop();
+            emit(cur.first);
+
+            if (readers[cur.second]->next(cur.first))
+            {
+                heads.push(cur);
+            }
+        }
+    }
+
+    string next_run()
+    {
+        return prefix + to_string(run_count++);
+    }
+
+    static void check(const ostream &strm, const string &name)
+    {
+        if (!strm.good())
+        {
+            throw runtime_error("build_csr_file: cannot write '" + name + "'");
+        }
+    }
+
+    string prefix;
+    size_t memory_budget, capacity;
+    size_t run_count = 0;
+    vector<T> buffer;
+    vector<string> runs;
+    Less less;
+};
+
+// An edge as read from the text format
+struct edge_record
+{
+    int32_t from, to, capacity;
+};
+
+struct by_source
+{
+    bool operator()(const edge_record &a, const edge_record &b) const
+    {
+        return a.from < b.from || (a.from == b.from && a.to < b.to);
+    }
+};
+
+// An edge filed under its target, for the in-arcs
+struct in_record
+{
+    int32_t to, from;
+    int64_t edge;
+};
+
+struct by_target
+{
+    bool operator()(const in_record &a, const in_record &b) const
+    {
+        return a.to < b.to || (a.to == b.to && a.edge < b.edge);
+    }
+};
+
+////////////////////////////////////////////////////////////////
+// Conversion
+////////////////////////////////////////////////////////////////
+
+bool is_csr_file(const string &path)
+{
+    char magic[sizeof(CSR_MAGIC)] = {};
+    ifstream strm(path, ios::binary);
+
+    strm.read(magic, sizeof(magic));
+    return strm.good() && memcmp(magic, CSR_MAGIC, sizeof(magic)) == 0;
+}
+
+// Turns per-node counts (at i + 1) into offsets, then writes them
+static void write_offsets(ostream &strm, vector<uint64_t> &offsets)
+{
+    for (size_t i = 1; i < offsets.size(); i++)
+    {
+        offsets[i] += offsets[i - 1];
+    }
+    strm.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+}
+
+// Reads the stream, sorting the edges by source, then writes the
+// out-arcs in that order while sorting them again by target for
+// the in-arcs. Takes O(e log e) time and two passes over the edges
+// on disk, plus one per extra merge level.
+static void write_csr_file(istream &strm, const string &path, const size_t &memory_budget)
+{
+    unsigned long num_nodes, num_links;
+
+    if (!(strm >> num_nodes >> num_links) || num_nodes > INT_MAX)
+    {
+        throw runtime_error("build_csr_file: expected a node count and an edge count");
+    }
+
+    const uint64_t n = num_nodes;
+    external_sorter<edge_record, by_source> edges(path + ".edges.", memory_budget);
+
+    for (unsigned long i = 0; i < num_links; i++)
+    {
+        long long from, to, capacity;
+
+        if (!(strm >> from >> to >> capacity))
+        {
+            throw runtime_error("build_csr_file: expected " + to_string(num_links) + " edges, found " +
+                                to_string(i));
+        }
+        if (from < 0 || from >= (long long)n || to < 0 || to >= (long long)n || capacity < INT_MIN ||
+            capacity > INT_MAX)
+        {
+            throw runtime_error("build_csr_file: edge " + to_string(i) + " is out of range");
+        }
+
+        edges.add(edge_record{(int32_t)from, (int32_t)to, (int32_t)capacity});
+    }
+
+    // The out-arcs, deduplicated as they stream past
+    const uint64_t out_offsets_at = sizeof(csr_header);
+    const uint64_t out_arcs_at = out_offsets_at + (n + 1) * sizeof(uint64_t);
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file.is_open())
+    {
+        throw runtime_error("build_csr_file: cannot write '" + path + "'");
+    }
+
+    vector<uint64_t> offsets(n + 1, 0);
+    external_sorter<in_record, by_target> incoming(path + ".in.", memory_budget / 2);
+    record_writer<csr_arc> arcs(file);
+    edge_record last;
+    int64_t m = 0;
+    bool pending = false;
+
+    auto keep = [&]() {
+        arcs.write(csr_arc{last.to, last.capacity});
+        offsets[last.from + 1]++;
+        incoming.add(in_record{last.to, last.from, m});
+        m++;
+    };
+
+    file.seekp(out_arcs_at);
+    edges.finish([&](const edge_record &record) {
+        // A repeated edge replaces the earlier one
+        if (pending && (record.from != last.from || record.to != last.to))
+        {
+            keep();
+        }
+        last = record;
+        pending = true;
+    });
+    if (pending)
+    {
+        keep();
+    }
+    arcs.flush();
+
+    file.seekp(out_offsets_at);
+    write_offsets(file, offsets);
+
+    // The in-arcs. Their two arrays are written through two streams
+    // so that each is written front to back.
+    const uint64_t in_offsets_at = out_arcs_at + m * sizeof(csr_arc);
+    const uint64_t in_edge_at = in_offsets_at + (n + 1) * sizeof(uint64_t);
+    const uint64_t in_from_at = in_edge_at + m * sizeof(int64_t);
+    ofstream from_file(path, ios::binary | ios::in | ios::out);
+    record_writer<int64_t> in_edges(file);
+    record_writer<int32_t> in_from(from_file);
+
+    offsets.assign(n + 1, 0);
+    file.seekp(in_edge_at);
+    from_file.seekp(in_from_at);
+    incoming.finish([&](const in_record &record) {
+        in_edges.write(record.edge);
+        in_from.write(record.from);
+        offsets[record.to + 1]++;
+    });
+    in_edges.flush();
+    in_from.flush();
+    from_file.close();
+
+    file.seekp(in_offsets_at);
+    write_offsets(file, offsets);
+
+    csr_header header = {};
+    memcpy(header.magic, CSR_MAGIC, sizeof(header.magic));
+    header.version = CSR_VERSION;
+    header.arc_size = sizeof(csr_arc);
+    header.nodes = n;
+    header.edges = m;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+
+    if (!file.good() || !from_file.good())
+    {
+        throw runtime_error("build_csr_file: cannot write '" + path + "'");
+    }
+}
+
+void build_csr_file(istream &strm, const string &path, const size_t &memory_budget)
+{
+    try
+    {
+        write_csr_file(strm, path, memory_budget);
+    }
+    catch (...)
+    {
+        remove(path.c_str());
+        throw;
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Mapping
+////////////////////////////////////////////////////////////////
+
+csr_graph::csr_graph(const string &path) : path(path)
+{
+    auto fail = [&path](const string &what) { throw runtime_error("csr_graph: " + path + ": " + what); };
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        fail(strerror(errno));
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(csr_header))
+    {
+        close(fd);
+        fail("not a CSR file");
+    }
+
+    mapped_bytes = status.st_size;
+    void *mapped = mmap(nullptr, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd); // the mapping keeps the file open
+    if (mapped == MAP_FAILED)
+    {
+        fail(strerror(error));
+    }
+    mapping = mapped;
+
+    const csr_header &header = *static_cast<const csr_header *>(mapping);
+    string problem;
+    if (memcmp(header.magic, CSR_MAGIC, sizeof(header.magic)) != 0)
+    {
+        problem = "not a CSR file";
+    }
+    else if (header.version != CSR_VERSION || header.arc_size != sizeof(csr_arc))
+    {
+        problem = "written by another version";
+    }
+    else if (header.nodes > INT_MAX || header.edges > mapped_bytes ||
+             mapped_bytes != sizeof(csr_header) + 2 * (header.nodes + 1) * sizeof(uint64_t) +
+                                 header.edges * (sizeof(csr_arc) + sizeof(int64_t) + sizeof(int32_t)))
+    {
+        problem = "file is truncated or damaged";
+    }
+    if (!problem.empty())
+    {
+        munmap(mapping, mapped_bytes);
+        fail(problem);
+    }
+
+    nodes = header.nodes;
+    edges = header.edges;
+
+    const char *at = static_cast<const char *>(mapping) + sizeof(csr_header);
+    out_offsets = reinterpret_cast<const uint64_t *>(at);
+    at += (nodes + 1) * sizeof(uint64_t);
+    out_arcs = reinterpret_cast<const csr_arc *>(at);
+    at += edges * sizeof(csr_arc);
+    in_offsets = reinterpret_cast<const uint64_t *>(at);
+    at += (nodes + 1) * sizeof(uint64_t);
+    in_edges = reinterpret_cast<const int64_t *>(at);
+    at += edges * sizeof(int64_t);
+    in_sources = reinterpret_cast<const int32_t *>(at);
+}
+
+csr_graph::~csr_graph()
+{
+    munmap(mapping, mapped_bytes);
+}
+
+////////////////////////////////////////////////////////////////
+// Solving
+////////////////////////////////////////////////////////////////
+
+// An array in a temporary file beside `near`, mapped shared so
+// that under memory pressure its pages are written back to that
+// file rather than to swap. The file is unlinked once mapped, and
+// starts out all zeros.
+template <typename T> class mapped_scratch
+{
+  public:
+    mapped_scratch(const string &near, const size_t &count) : bytes(max(count, (size_t)1) * sizeof(T))
+    {
+        string name = near + ".flow.XXXXXX";
+        vector<char> path(name.begin(), name.end());
+        path.push_back('\0');
+
+        int fd = mkstemp(path.data());
+        if (fd < 0)
+        {
+            throw runtime_error("mapped_scratch: " + name + ": " + strerror(errno));
+        }
+        unlink(path.data());
+
+        void *mapped = MAP_FAILED;
+        if (ftruncate(fd, bytes) == 0)
+        {
+            mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        int error = errno;
+        close(fd);
+
+        if (mapped == MAP_FAILED)
+        {
+            throw runtime_error("mapped_scratch: " + name + ": " + strerror(error));
+        }
+        data = static_cast<T *>(mapped);
+    }
+
+    ~mapped_scratch()
+    {
+        munmap(data, bytes);
+    }
+
+    mapped_scratch(const mapped_scratch &) = delete;
+    mapped_scratch &operator=(const mapped_scratch &) = delete;
+
+    T &operator[](const int64_t &i)
+    {
+        return data[i];
+    }
+
+  private:
+    T *data = nullptr;
+    size_t bytes;
+};
+
+// The per-node search state, which stays in memory. via[i] is the
+// edge the search reached i over: e for a forwards step along edge
+// e, or ~e for a backwards one against it.
+struct csr_search
+{
+    node_bitset visited;
+    vector<int> parent, frontier, next;
+    vector<int64_t> via;
+    vector<int> residual, scratch; // one node's out-arcs at a time
+};
+
+// Breadth first search of the residual graph from s. Returns
+// whether t was reached.
+static bool csr_bfs(const csr_graph &on, mapped_scratch<int32_t> &flow, const int &s, const int &t, csr_search &ws)
+{
+    auto reach = [&ws](const int &node, const int &from, const int64_t &via) {
+        ws.visited.set(node);
+        ws.parent[node] = from;
+        ws.via[node] = via;
+        ws.next.push_back(node);
+    };
+
+    ws.visited.clear();
+    ws.visited.set(s);
+    ws.frontier.assign(1, s);
+    ws.next.clear();
+
+    while (!ws.frontier.empty())
+    {
+        // In node order, a level reads the offsets, the arcs and
+        // the flows front to back, so the page cache can read ahead
+        // instead of seeking
+        sort(ws.frontier.begin(), ws.frontier.end());
+
+        for (const int &cur : ws.frontier)
+        {
+            // Forwards edges with remaining capacity. A node's arcs
+            // and flows are contiguous, so its residuals are worked
+            // out in one pass and filtered by the vector kernel.
+            int64_t begin = on.out_begin(cur);
+            size_t degree = (size_t)(on.out_end(cur) - begin);
+            if (ws.residual.size() < degree)
+            {
+                ws.residual.resize(degree);
+                ws.scratch.resize(degree);
+            }
+
+            for (size_t i = 0; i < degree; i++)
+            {
+                ws.residual[i] = on.arc(begin + i).capacity - flow[begin + i];
+            }
+
+            size_t count = kernels().filter_positive(ws.residual.data(), degree, ws.scratch.data());
+            for (size_t i = 0; i < count; i++)
+            {
+                int64_t e = begin + ws.scratch[i];
+                const csr_arc &arc = on.arc(e);
+                if (!ws.visited.test(arc.to))
+                {
+                    reach(arc.to, cur, e);
+                    if (arc.to == t)
+                    {
+                        return true;
+                    }
+                }
+            }
+
+            // Backwards edges with flow to cancel
+            for (int64_t k = on.in_begin(cur); k < on.in_end(cur); k++)
+            {
+                int from = on.in_from(k);
+                int64_t e = on.in_edge(k);
+                if (!ws.visited.test(from) && flow[e] > 0)
+                {
+                    reach(from, cur, ~e);
+                    if (from == t)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        swap(ws.frontier, ws.next);
+        ws.next.clear();
+    }
+
+    return false;
+}
+
+// Returns the maxflow of a mapped graph using the Edmonds Karp
+// algorithm, with the flows in a mapped scratch file
+int edmonds_karp(const csr_graph &on, const int &s, const int &t, int &iterations, const bool &verbose)
+{
+    mapped_scratch<int32_t> flow(on.file(), on.edge_count());
+    csr_search ws;
+    int out = 0;
+
+    iterations = 0;
+    ws.visited.resize(on.node_count());
+    ws.parent.resize(on.node_count());
+    ws.via.resize(on.node_count());
+
+    while (s != t && csr_bfs(on, flow, s, t, ws))
+    {
+        // The bottleneck, then the augmentation, back from t
+        int net_flow = INT_MAX;
+        for (int position = t; position != s; position = ws.parent[position])
+        {
+            int64_t via = ws.via[position];
+            int available = (via >= 0) ? on.arc(via).capacity - flow[via] : flow[~via];
+            net_flow = (available < net_flow) ? available : net_flow;
+        }
+
+        for (int position = t; position != s; position = ws.parent[position])
+        {
+            int64_t via = ws.via[position];
+            if (via >= 0)
+            {
+                flow[via] += net_flow;
+            }
+            else
+            {
+                flow[~via] -= net_flow;
+            }
+        }
+
+        out += net_flow;
+        iterations++;
+
+        if (verbose)
+        {
+            cout << "EK is on iteration " << iterations << "\t w/ flow " << out << '\n';
+        }
+    }
+
+    return out;
+}
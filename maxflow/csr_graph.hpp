@@ -0,0 +1,232 @@
+/**
+ * @file csr_graph.hpp
+ *
+ * @brief Out-of-core graphs: a streaming conversion of the text
+ *        format into an on-disk compressed sparse row (CSR) file,
+ *        and an Edmonds-Karp solver which works on that file
+ *        through mmap.
+ *
+ * `load_graph` needs the whole graph in memory, and the solvers
+ * keep three copies of it. Here the edges never all sit in memory
+ * at once: the conversion sorts them by source with an external
+ * merge sort whose runs are bounded by a memory budget, and the
+ * solver reads capacities from the mapped file and keeps its flows
+ * in a mapped scratch file, so the OS page cache decides what is
+ * resident. Only per-node arrays (offsets while converting, the
+ * BFS state while solving) are held in memory.
+ *
+ * File layout, all in native byte order:
+ *
+ *     csr_header
+ *     uint64_t out_offsets[nodes + 1]   arcs of node i are
+ *     csr_arc  out_arcs[edges]          out_arcs[out_offsets[i]..]
+ *     uint64_t in_offsets[nodes + 1]    arcs into node i are
+ *     int64_t  in_edge[edges]           in_edge[in_offsets[i]..]
+ *     int32_t  in_from[edges]           (with sources in in_from)
+ *
+ * Arcs are sorted by target within each node, and repeated edges
+ * keep their last capacity, as with `load_graph`.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef CSR_GRAPH_HPP
+#define CSR_GRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/**
+ * @brief The memory `build_csr_file` sorts in by default
+ */
+const size_t CSR_DEFAULT_MEMORY = (size_t)256 << 20;
+
+/**
+ * @struct csr_header
+ * @brief The start of a CSR file
+ *
+ * @var csr_header::magic
+ * "MAXFLOW" and a zero byte
+ * @var csr_header::version
+ * The layout version
+ * @var csr_header::arc_size
+ * sizeof(csr_arc) when written, to catch foreign files
+ * @var csr_header::nodes
+ * The number of nodes
+ * @var csr_header::edges
+ * The number of distinct edges
+ */
+struct csr_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t arc_size;
+    uint64_t nodes;
+    uint64_t edges;
+};
+
+/**
+ * @struct csr_arc
+ * @brief An edge as stored in the out-arcs of its source
+ *
+ * @var csr_arc::to
+ * The index of the node the edge points to
+ * @var csr_arc::capacity
+ * The capacity of the edge
+ */
+struct csr_arc
+{
+    int32_t to;
+    int32_t capacity;
+};
+
+/**
+ * @brief Returns whether the file at `path` starts like a CSR
+ *        file, as opposed to the text format
+ *
+ * @param path The file to check
+ */
+bool is_csr_file(const std::string &path);
+
+/**
+ * @brief Converts a graph in the text format read by
+ *        `load_graph` into a CSR file, reading the stream once.
+ *        Edges are sorted by an external merge sort, with the
+ *        runs kept in temporary files next to `path`.
+ *
+ * @param strm The stream to convert
+ * @param path The CSR file to write
+ * @param memory_budget About the most memory to sort edges in,
+ *        in bytes; per-node arrays come on top of it
+ *
+ * @throw std::runtime_error if the input is malformed or a file
+ *        cannot be written
+ */
+void build_csr_file(std::istream &strm, const std::string &path, const size_t &memory_budget = CSR_DEFAULT_MEMORY);
+
+/**
+ * @class csr_graph
+ * @brief A read-only, memory-mapped CSR file. Nothing is read
+ *        until used, and pages can be dropped again under memory
+ *        pressure since they are backed by the file.
+ */
+class csr_graph
+{
+  public:
+    /**
+     * @brief Maps a file written by `build_csr_file`
+     *
+     * @param path The file to map
+     *
+     * @throw std::runtime_error if it cannot be mapped, or is not
+     *        a CSR file of this version
+     */
+    explicit csr_graph(const std::string &path);
+
+    ~csr_graph();
+
+    csr_graph(const csr_graph &) = delete;
+    csr_graph &operator=(const csr_graph &) = delete;
+
+    /**
+     * @brief Returns the number of nodes
+     */
+    int node_count() const
+    {
+        return (int)nodes;
+    }
+
+    /**
+     * @brief Returns the number of edges
+     */
+    int64_t edge_count() const
+    {
+        return (int64_t)edges;
+    }
+
+    /**
+     * @brief Node i's out-arcs are arc(e) for out_begin(i) <= e <
+     *        out_end(i), and e is also the edge's index
+     */
+    int64_t out_begin(const int &i) const
+    {
+        return (int64_t)out_offsets[i];
+    }
+
+    int64_t out_end(const int &i) const
+    {
+        return (int64_t)out_offsets[i + 1];
+    }
+
+    const csr_arc &arc(const int64_t &e) const
+    {
+        return out_arcs[e];
+    }
+
+    /**
+     * @brief The edges into node i are in_edge(k) from in_from(k)
+     *        for in_begin(i) <= k < in_end(i)
+     */
+    int64_t in_begin(const int &i) const
+    {
+        return (int64_t)in_offsets[i];
+    }
+
+    int64_t in_end(const int &i) const
+    {
+        return (int64_t)in_offsets[i + 1];
+    }
+
+    int64_t in_edge(const int64_t &k) const
+    {
+        return in_edges[k];
+    }
+
+    int in_from(const int64_t &k) const
+    {
+        return in_sources[k];
+    }
+
+    /**
+     * @brief Returns the path the graph was mapped from
+     */
+    const std::string &file() const
+    {
+        return path;
+    }
+
+  private:
+    std::string path;
+    void *mapping = nullptr;
+    size_t mapped_bytes = 0;
+    uint64_t nodes = 0, edges = 0;
+    const uint64_t *out_offsets = nullptr, *in_offsets = nullptr;
+    const csr_arc *out_arcs = nullptr;
+    const int64_t *in_edges = nullptr;
+    const int32_t *in_sources = nullptr;
+};
+
+/**
+ * @brief Returns the maxflow of a mapped graph using the Edmonds
+ *        Karp algorithm. The flow on each edge lives in a mapped
+ *        scratch file beside the graph, removed when done. Each
+ *        BFS level is expanded in node order, so the mapped
+ *        arrays are read front to back.
+ *
+ * @param on The graph to operate on
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param iterations Replaced by the number of iterations
+ * @param verbose Whether to log each iteration to `cout`
+ *
+ * @return The max flow across the graph from `s` to `t`
+ *
+ * @throw std::runtime_error if the scratch file cannot be made
+ */
+int edmonds_karp(const csr_graph &on, const int &s, const int &t, int &iterations, const bool &verbose = true);
+
+#endif
@@ -1,6 +1,11 @@
 /*
 Generates random large graphs
 Not necessarily acyclic
+
+With a fourth argument of "bipartite", instead generates a
+unit-capacity bipartite matching problem: node 0 is the source,
+node n - 1 is the sink, and the e random edges go from the first
+half of the other nodes to the second half.
 */
 
 #include "maxflow.hpp"
@@ -17,8 +22,9 @@ int main(int argc, char *argv[])
     graph g;
     unsigned long long n = 0, e = 0;
     string file;
+    bool bipartite = false;
 
-    if (argc != 4)
+    if (argc != 4 && argc != 5)
     {
         cout << "File: ";
         cin >> file;
@@ -32,6 +38,7 @@ int main(int argc, char *argv[])
         file = argv[1];
         n = atoi(argv[2]);
         e = atoi(argv[3]);
+        bipartite = (argc == 5 && string(argv[4]) == "bipartite");
     }
 
     if (n < 0 || e < 0)
@@ -40,28 +47,54 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (bipartite && n < 4)
+    {
+        cout << "Bipartite graphs need at least 4 nodes\n";
+        return 1;
+    }
+
     srand(time(NULL));
 
     // Create nodes
-    for (int i = 0; i < n; i++)
+    for (unsigned long long i = 0; i < n; i++)
     {
         g.nodes.push_back(graph_node{});
     }
 
     // Create edges
-    for (int i = 0; i < e; i++)
+    if (bipartite)
     {
-        int from, to, weight;
-        from = rand() % n;
+        int left = (n - 2) / 2, right = n - 2 - left;
 
-        do
+        for (int i = 1; i <= left; i++)
+        {
+            g.nodes[0].edges[i] = 1;
+        }
+        for (int i = left + 1; i <= left + right; i++)
         {
-            to = rand() % n;
-        } while (from == to);
+            g.nodes[i].edges[n - 1] = 1;
+        }
+        for (unsigned long long i = 0; i < e; i++)
+        {
+            g.nodes[1 + rand() % left].edges[left + 1 + rand() % right] = 1;
+        }
+    }
+    else
+    {
+        for (unsigned long long i = 0; i < e; i++)
+        {
+            int from, to, weight;
+            from = rand() % n;
+
+            do
+            {
+                to = rand() % n;
+            } while (from == to);
 
-        weight = W_MIN + (rand() % (W_MAX - W_MIN));
+            weight = W_MIN + (rand() % (W_MAX - W_MIN));
 
-        g.nodes[from].edges[to] = weight;
+            g.nodes[from].edges[to] = weight;
+        }
     }
 
     // Save to file
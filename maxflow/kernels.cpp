@@ -0,0 +1,385 @@
+#include "kernels.hpp"
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////
+// Portable (scalar) kernels
+////////////////////////////////////////////////////////////////
+
+// Branch-free so that -O3 can vectorize it on any target
+static int min_positive_weight_scalar(const edge *edges, size_t n)
+{
+    int min = INT_MAX;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int w = edges[i].weight;
+        int candidate = (w > 0) ? w : INT_MAX;
+        min = (candidate < min) ? candidate : min;
+    }
+
+    return min;
+}
+
+// Writes unconditionally and advances conditionally, so there is
+// no data-dependent branch in the loop
+static size_t filter_positive_scalar(const int *values, size_t n, int *out)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        out[count] = (int)i;
+        count += (values[i] > 0);
+    }
+
+    return count;
+}
+
+static size_t filter_unvisited_scalar(const int *nodes, size_t n, const uint64_t *visited, int *out)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int node = nodes[i];
+        out[count] = node;
+        count += ((visited[node >> 6] >> (node & 63)) & 1) ^ 1;
+    }
+
+    return count;
+}
+
+#ifdef KERNELS_X86
+
+////////////////////////////////////////////////////////////////
+// Left-packing tables
+////////////////////////////////////////////////////////////////
+
+// avx2_pack[mask] lists the set lanes of an 8-bit lane mask
+// first, for use with _mm256_permutevar8x32_epi32
+static uint32_t avx2_pack[256][8];
+
+// sse_pack[mask] is the byte shuffle which moves the set 32-bit
+// lanes of a 4-bit lane mask to the front, for _mm_shuffle_epi8
+static uint8_t sse_pack[16][16];
+
+static void build_pack_tables()
+{
+    for (int mask = 0; mask < 256; mask++)
+    {
+        int k = 0;
+        for (int lane = 0; lane < 8; lane++)
+        {
+            if (mask & (1 << lane))
+            {
+                avx2_pack[mask][k++] = lane;
+            }
+        }
+        while (k < 8)
+        {
+            avx2_pack[mask][k++] = 0;
+        }
+    }
+
+    for (int mask = 0; mask < 16; mask++)
+    {
+        int k = 0;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (mask & (1 << lane))
+            {
+                for (int byte = 0; byte < 4; byte++)
+                {
+                    sse_pack[mask][4 * k + byte] = 4 * lane + byte;
+                }
+                k++;
+            }
+        }
+        for (int byte = 4 * k; byte < 16; byte++)
+        {
+            sse_pack[mask][byte] = 0x80;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// SSE4.1 kernels
+////////////////////////////////////////////////////////////////
+
+// An edge is {to, weight}, so in a vector of edges the weights
+// are the odd 32-bit lanes
+__attribute__((target("sse4.1"))) static int min_positive_weight_sse41(const edge *edges, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i none = _mm_set1_epi32(INT_MAX);
+    const __m128i odd = _mm_set_epi32(-1, 0, -1, 0);
+    __m128i min = none;
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(edges + i));
+        __m128i keep = _mm_and_si128(_mm_cmpgt_epi32(v, zero), odd);
+        min = _mm_min_epi32(min, _mm_blendv_epi8(none, v, keep));
+    }
+
+    min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+    min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+    int out = _mm_cvtsi128_si32(min);
+
+    int rest = min_positive_weight_scalar(edges + i, n - i);
+    return (rest < out) ? rest : out;
+}
+
+__attribute__((target("sse4.1"))) static size_t filter_positive_sse41(const int *values, size_t n, int *out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i indices = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i step = _mm_set1_epi32(4);
+    size_t count = 0, i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, zero)));
+        __m128i shuffle = _mm_loadu_si128((const __m128i *)sse_pack[mask]);
+
+        // count <= i, so these four slots are within the first n
+        _mm_storeu_si128((__m128i *)(out + count), _mm_shuffle_epi8(indices, shuffle));
+        count += __builtin_popcount(mask);
+        indices = _mm_add_epi32(indices, step);
+    }
+
+    for (; i < n; i++)
+    {
+        out[count] = (int)i;
+        count += (values[i] > 0);
+    }
+
+    return count;
+}
+
+// SSE4.1 has neither a gather nor a per-lane shift. The four
+// bitmap words are loaded one at a time (as the 32-bit half of
+// each 64-bit word which holds the node's bit), and each lane's
+// 1 << (node & 31) is built as the float 2^(node & 31) and
+// truncated back to an integer. 2^31 is out of range, for which
+// cvttps gives 0x80000000: bit 31, as wanted.
+__attribute__((target("sse4.1"))) static size_t filter_unvisited_sse41(const int *nodes, size_t n,
+                                                                       const uint64_t *visited, int *out)
+{
+    const __m128i low5 = _mm_set1_epi32(31);
+    const __m128i bias = _mm_set1_epi32(127);
+    const __m128i zero = _mm_setzero_si128();
+    auto half = [visited](const int &node) { return (int)(uint32_t)(visited[node >> 6] >> (node & 32)); };
+    size_t count = 0, i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(nodes + i));
+        __m128i words = _mm_set_epi32(half(nodes[i + 3]), half(nodes[i + 2]), half(nodes[i + 1]), half(nodes[i]));
+        __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_and_si128(v, low5), bias), 23);
+        __m128i bit = _mm_cvttps_epi32(_mm_castsi128_ps(exponent));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(words, bit), zero)));
+        __m128i shuffle = _mm_loadu_si128((const __m128i *)sse_pack[mask]);
+
+        // count <= i, so this never overtakes unread input when
+        // out aliases nodes
+        _mm_storeu_si128((__m128i *)(out + count), _mm_shuffle_epi8(v, shuffle));
+        count += __builtin_popcount(mask);
+    }
+
+    return count + filter_unvisited_scalar(nodes + i, n - i, visited, out + count);
+}
+
+////////////////////////////////////////////////////////////////
+// AVX2 kernels
+////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx2"))) static int min_positive_weight_avx2(const edge *edges, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i none = _mm256_set1_epi32(INT_MAX);
+    const __m256i odd = _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+    __m256i min = none;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(edges + i));
+        __m256i keep = _mm256_and_si256(_mm256_cmpgt_epi32(v, zero), odd);
+        min = _mm256_min_epi32(min, _mm256_blendv_epi8(none, v, keep));
+    }
+
+    __m128i half = _mm_min_epi32(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+    half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    int out = _mm_cvtsi128_si32(half);
+
+    int rest = min_positive_weight_scalar(edges + i, n - i);
+    return (rest < out) ? rest : out;
+}
+
+__attribute__((target("avx2"))) static size_t filter_positive_avx2(const int *values, size_t n, int *out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i indices = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t count = 0, i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(values + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, zero)));
+        __m256i perm = _mm256_loadu_si256((const __m256i *)avx2_pack[mask]);
+
+        // count <= i, so these eight slots are within the first n
+        _mm256_storeu_si256((__m256i *)(out + count), _mm256_permutevar8x32_epi32(indices, perm));
+        count += __builtin_popcount(mask);
+        indices = _mm256_add_epi32(indices, step);
+    }
+
+    for (; i < n; i++)
+    {
+        out[count] = (int)i;
+        count += (values[i] > 0);
+    }
+
+    return count;
+}
+
+// Gathers the 32-bit bitmap word holding each node's bit. On
+// little-endian x86 bit `node` of the 64-bit word array is bit
+// `node & 31` of 32-bit word `node >> 5`.
+__attribute__((target("avx2"))) static size_t filter_unvisited_avx2(const int *nodes, size_t n,
+                                                                     const uint64_t *visited, int *out)
+{
+    const __m256i low5 = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t count = 0, i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(nodes + i));
+        __m256i words = _mm256_i32gather_epi32((const int *)visited, _mm256_srli_epi32(v, 5), 4);
+        __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(v, low5)), one);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, zero)));
+        __m256i perm = _mm256_loadu_si256((const __m256i *)avx2_pack[mask]);
+
+        // count <= i, so this never overtakes unread input when
+        // out aliases nodes
+        _mm256_storeu_si256((__m256i *)(out + count), _mm256_permutevar8x32_epi32(v, perm));
+        count += __builtin_popcount(mask);
+    }
+
+    return count + filter_unvisited_scalar(nodes + i, n - i, visited, out + count);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////
+// Dispatch
+////////////////////////////////////////////////////////////////
+
+static const flow_kernels scalar_kernels = {
+    kernel_isa::scalar, "scalar", min_positive_weight_scalar, filter_positive_scalar, filter_unvisited_scalar,
+};
+
+#ifdef KERNELS_X86
+static const flow_kernels sse41_kernels = {
+    kernel_isa::sse41, "sse4.1", min_positive_weight_sse41, filter_positive_sse41, filter_unvisited_sse41,
+};
+
+static const flow_kernels avx2_kernels = {
+    kernel_isa::avx2, "avx2", min_positive_weight_avx2, filter_positive_avx2, filter_unvisited_avx2,
+};
+#endif
+
+static const flow_kernels *table_for(const kernel_isa &isa)
+{
+#ifdef KERNELS_X86
+    switch (isa)
+    {
+    case kernel_isa::avx2:
+        return &avx2_kernels;
+    case kernel_isa::sse41:
+        return &sse41_kernels;
+    default:
+        break;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+kernel_isa detect_kernel_isa()
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return kernel_isa::avx2;
+    }
+    else if (__builtin_cpu_supports("sse4.1"))
+    {
+        return kernel_isa::sse41;
+    }
+#endif
+    return kernel_isa::scalar;
+}
+
+// Picked once, on first use (function-local statics are
+// initialized thread-safely)
+static const flow_kernels *&active_kernels()
+{
+    static const flow_kernels *active = []() {
+#ifdef KERNELS_X86
+        build_pack_tables();
+#endif
+        return table_for(detect_kernel_isa());
+    }();
+
+    return active;
+}
+
+const flow_kernels &kernels()
+{
+    return *active_kernels();
+}
+
+bool select_kernels(const kernel_isa &isa)
+{
+    if (isa > detect_kernel_isa())
+    {
+        return false;
+    }
+
+    // Builds the tables if they are not built yet
+    active_kernels() = table_for(isa);
+    return true;
+}
+
+bool select_kernels(const string &name)
+{
+    if (name == "scalar")
+    {
+        return select_kernels(kernel_isa::scalar);
+    }
+    else if (name == "sse4.1" || name == "sse41")
+    {
+        return select_kernels(kernel_isa::sse41);
+    }
+    else if (name == "avx2")
+    {
+        return select_kernels(kernel_isa::avx2);
+    }
+
+    return false;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file kernels.hpp
+ *
+ * @brief Vectorized inner-loop kernels for the maxflow solvers,
+ *        with a portable fallback and runtime dispatch.
+ *
+ * Every kernel has a scalar version which is always available.
+ * On x86 an SSE4.1 and an AVX2 version are also compiled (via
+ * per-function target attributes, so the rest of the program
+ * does not need `-mavx2`), and the widest one supported by the
+ * running CPU is picked the first time `kernels()` is called.
+ * On other architectures (ex. ARM) the scalar versions are
+ * written branch-free so that the compiler can auto-vectorize
+ * them for NEON.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include "maxflow.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @enum kernel_isa
+ * @brief The instruction sets a kernel table can be built for
+ */
+enum class kernel_isa
+{
+    scalar,
+    sse41,
+    avx2
+};
+
+/**
+ * @struct flow_kernels
+ * @brief A table of kernel function pointers for one ISA
+ *
+ * @var flow_kernels::isa
+ * The instruction set these kernels use
+ *
+ * @var flow_kernels::name
+ * A printable name for the instruction set
+ *
+ * @var flow_kernels::min_positive_weight
+ * Returns the minimum strictly positive `weight` among the `n`
+ * edges starting at `edges`, or `INT_MAX` if there is none.
+ *
+ * @var flow_kernels::filter_positive
+ * Writes the index of every strictly positive entry among the
+ * `n` values starting at `values` into `out`, in order, and
+ * returns how many were written. `out` must have room for `n`
+ * entries.
+ *
+ * @var flow_kernels::filter_unvisited
+ * Writes every node id among the `n` ids starting at `nodes`
+ * whose bit is clear in the `visited` bitmap into `out`, in
+ * order, and returns how many were written. `out` must have
+ * room for `n` entries, and may alias `nodes`.
+ */
+struct flow_kernels
+{
+    kernel_isa isa;
+    const char *name;
+
+    int (*min_positive_weight)(const edge *edges, size_t n);
+    size_t (*filter_positive)(const int *values, size_t n, int *out);
+    size_t (*filter_unvisited)(const int *nodes, size_t n, const uint64_t *visited, int *out);
+};
+
+/**
+ * @brief Returns the widest instruction set supported by the
+ *        CPU this is running on
+ *
+ * @return The detected instruction set
+ */
+kernel_isa detect_kernel_isa();
+
+/**
+ * @brief Returns the kernel table currently in use. On the
+ *        first call this selects the widest supported ISA.
+ *
+ * @return The active kernel table
+ */
+const flow_kernels &kernels();
+
+/**
+ * @brief Switches the active kernel table. Intended to be
+ *        called once at startup, before any solver runs.
+ *
+ * @param isa The instruction set to use
+ *
+ * @return False (and leaves the table unchanged) if the CPU
+ *         does not support `isa`
+ */
+bool select_kernels(const kernel_isa &isa);
+
+/**
+ * @brief Switches the active kernel table by name ("scalar",
+ *        "sse4.1" or "avx2").
+ *
+ * @param name The name of the instruction set to use
+ *
+ * @return False (and leaves the table unchanged) if the name
+ *         is unknown or the CPU does not support it
+ */
+bool select_kernels(const std::string &name);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+Checks every kernel table the CPU supports against the scalar one
+
+Each kernel is run on random inputs of every length from 0 to 17,
+which covers the scalar tail after whole SSE4.1 (4 lane) and AVX2
+(8 lane) steps. filter_unvisited is also run in place, with `out`
+aliasing `nodes`, as bfs_top_down uses it.
+
+usage: kernels_check.out [seed]
+*/
+
+#include "kernels.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+const static size_t MAX_LENGTH = 17;
+const static int TRIALS = 200;
+const static int NODES = 256;
+
+int main(int argc, char *argv[])
+{
+    unsigned long seed = (argc == 2) ? strtoul(argv[1], nullptr, 10) : 1;
+    mt19937 random(seed);
+    uniform_int_distribution<int> any_node(0, NODES - 1);
+    uniform_int_distribution<int> any_weight(-3, 3);
+
+    select_kernels(kernel_isa::scalar);
+    const flow_kernels scalar = kernels();
+    int failures = 0;
+
+    for (kernel_isa isa : {kernel_isa::sse41, kernel_isa::avx2})
+    {
+        if (!select_kernels(isa))
+        {
+            continue;
+        }
+        const flow_kernels &vector_kernels = kernels();
+        int before = failures;
+
+        auto fail = [&](const char *kernel, const size_t &n) {
+            cerr << "Error: " << vector_kernels.name << " " << kernel << " differs from scalar at length " << n
+                 << " (seed=" << seed << ")\n";
+            failures++;
+        };
+
+        for (size_t n = 0; n <= MAX_LENGTH; n++)
+        {
+            for (int trial = 0; trial < TRIALS; trial++)
+            {
+                // Weights around zero, with the extremes mixed in
+                vector<edge> edges(n);
+                vector<int> values(n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    int w = any_weight(random);
+                    w = (w == 3) ? INT_MAX : (w == -3) ? INT_MIN : w;
+                    edges[i] = edge{any_node(random), w};
+                    values[i] = w;
+                }
+
+                if (vector_kernels.min_positive_weight(edges.data(), n) != scalar.min_positive_weight(edges.data(), n))
+                {
+                    fail("min_positive_weight", n);
+                }
+
+                vector<int> expected(n), got(n);
+                size_t count = scalar.filter_positive(values.data(), n, expected.data());
+                if (vector_kernels.filter_positive(values.data(), n, got.data()) != count ||
+                    !equal(expected.begin(), expected.begin() + count, got.begin()))
+                {
+                    fail("filter_positive", n);
+                }
+
+                // Random visited bits, including bits 31 and 63 of
+                // their words
+                vector<uint64_t> visited(NODES / 64);
+                for (auto &word : visited)
+                {
+                    word = ((uint64_t)random() << 32) | random();
+                }
+                vector<int> nodes(n);
+                for (auto &node : nodes)
+                {
+                    node = any_node(random);
+                }
+
+                count = scalar.filter_unvisited(nodes.data(), n, visited.data(), expected.data());
+                if (vector_kernels.filter_unvisited(nodes.data(), n, visited.data(), got.data()) != count ||
+                    !equal(expected.begin(), expected.begin() + count, got.begin()))
+                {
+                    fail("filter_unvisited", n);
+                }
+
+                if (vector_kernels.filter_unvisited(nodes.data(), n, visited.data(), nodes.data()) != count ||
+                    !equal(expected.begin(), expected.begin() + count, nodes.begin()))
+                {
+                    fail("filter_unvisited (in place)", n);
+                }
+            }
+        }
+
+        cout << vector_kernels.name << " kernels: " << (failures == before ? "ok" : "FAILED") << '\n';
+    }
+
+    return (failures == 0) ? 0 : 1;
+}
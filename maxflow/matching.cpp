@@ -0,0 +1,238 @@
+#include "matching.hpp"
+#include <climits>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////
+// Detection
+////////////////////////////////////////////////////////////////
+
+// Side of each node in a candidate bipartite problem
+static const unsigned char SIDE_NONE = 0, SIDE_LEFT = 1, SIDE_RIGHT = 2;
+
+bool detect_bipartite_matching(const graph &on, const int &s, const int &t, bipartite_instance &out)
+{
+    const int n = (int)on.nodes.size();
+    vector<unsigned char> side(n, SIDE_NONE);
+    vector<int> local(n, -1);
+
+    out = bipartite_instance{};
+
+    // Left nodes are exactly the source's neighbors
+    for (const auto &edge_item : on.nodes[s].edges)
+    {
+        if (edge_item.second != 1 || edge_item.first == t)
+        {
+            return false;
+        }
+
+        side[edge_item.first] = SIDE_LEFT;
+        local[edge_item.first] = (int)out.left.size();
+        out.left.push_back(edge_item.first);
+    }
+
+    if (!on.nodes[t].edges.empty())
+    {
+        return false;
+    }
+
+    // Right nodes are exactly the sink's neighbors. Scanning the
+    // edges (rather than t's backwards edge set) also works for
+    // graphs which were not built by load_graph.
+    for (int from = 0; from < n; from++)
+    {
+        auto it = on.nodes[from].edges.find(t);
+        if (from == s || it == on.nodes[from].edges.end())
+        {
+            continue;
+        }
+
+        if (it->second != 1 || side[from] == SIDE_LEFT)
+        {
+            return false;
+        }
+
+        side[from] = SIDE_RIGHT;
+        local[from] = (int)out.right.size();
+        out.right.push_back(from);
+    }
+
+    // Everything else must be a unit edge from left to right
+    out.offsets.assign(out.left.size() + 1, 0);
+    for (int from = 0; from < n; from++)
+    {
+        if (from == s)
+        {
+            continue;
+        }
+
+        for (const auto &edge_item : on.nodes[from].edges)
+        {
+            if (edge_item.first == t && side[from] == SIDE_RIGHT)
+            {
+                continue;
+            }
+
+            if (side[from] != SIDE_LEFT || side[edge_item.first] != SIDE_RIGHT || edge_item.second != 1)
+            {
+                return false;
+            }
+
+            out.offsets[local[from] + 1]++;
+        }
+    }
+
+    for (size_t i = 0; i < out.left.size(); i++)
+    {
+        out.offsets[i + 1] += out.offsets[i];
+    }
+
+    out.targets.resize(out.offsets.back());
+    for (size_t i = 0; i < out.left.size(); i++)
+    {
+        int position = out.offsets[i];
+        for (const auto &edge_item : on.nodes[out.left[i]].edges)
+        {
+            out.targets[position++] = local[edge_item.first];
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+// Hopcroft-Karp
+////////////////////////////////////////////////////////////////
+
+// Layers the free left nodes and everything reachable from them
+// by alternating paths. Returns true if some free right node is
+// reachable, ie if there is an augmenting path.
+static bool hk_layer(const bipartite_instance &instance, const vector<int> &match_left,
+                     const vector<int> &match_right, vector<int> &dist, vector<int> &queue)
+{
+    bool found = false;
+
+    queue.clear();
+    for (size_t u = 0; u < instance.left.size(); u++)
+    {
+        if (match_left[u] == -1)
+        {
+            dist[u] = 0;
+            queue.push_back((int)u);
+        }
+        else
+        {
+            dist[u] = INT_MAX;
+        }
+    }
+
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        int u = queue[head];
+        for (int i = instance.offsets[u]; i < instance.offsets[u + 1]; i++)
+        {
+            int w = match_right[instance.targets[i]];
+
+            if (w == -1)
+            {
+                found = true;
+            }
+            else if (dist[w] == INT_MAX)
+            {
+                dist[w] = dist[u] + 1;
+                queue.push_back(w);
+            }
+        }
+    }
+
+    return found;
+}
+
+// Depth first search along the layers from a free left node,
+// using an explicit stack. cursor[u] is the next edge of u to
+// try, so each edge is tried at most once per phase. Dead ends
+// are removed from the layering. Returns true if it augmented.
+static bool hk_augment(const bipartite_instance &instance, const int &root, vector<int> &match_left,
+                       vector<int> &match_right, vector<int> &dist, vector<int> &cursor, vector<int> &stack)
+{
+    stack.clear();
+    stack.push_back(root);
+
+    while (!stack.empty())
+    {
+        int u = stack.back();
+
+        if (cursor[u] == instance.offsets[u + 1])
+        {
+            dist[u] = INT_MAX;
+            stack.pop_back();
+            continue;
+        }
+
+        int v = instance.targets[cursor[u]];
+        int w = match_right[v];
+
+        if (w == -1)
+        {
+            // Flip the alternating path held on the stack
+            for (const int &node : stack)
+            {
+                int to = instance.targets[cursor[node]];
+                match_left[node] = to;
+                match_right[to] = node;
+            }
+            return true;
+        }
+        else if (dist[w] == dist[u] + 1)
+        {
+            // Revisit this edge if w turns out to be a dead end
+            stack.push_back(w);
+        }
+        else
+        {
+            cursor[u]++;
+        }
+    }
+
+    return false;
+}
+
+int hopcroft_karp(const bipartite_instance &instance, vector<pair<int, int>> &matching, int &phases)
+{
+    const size_t n_left = instance.left.size();
+    vector<int> match_left(n_left, -1), match_right(instance.right.size(), -1);
+    vector<int> dist(n_left), cursor(n_left), queue, stack;
+    int out = 0;
+
+    phases = 0;
+
+    // O(sqrt(n)) phases of O(e) each
+    while (hk_layer(instance, match_left, match_right, dist, queue))
+    {
+        for (size_t u = 0; u < n_left; u++)
+        {
+            cursor[u] = instance.offsets[u];
+        }
+
+        for (size_t u = 0; u < n_left; u++)
+        {
+            if (match_left[u] == -1 && hk_augment(instance, (int)u, match_left, match_right, dist, cursor, stack))
+            {
+                out++;
+            }
+        }
+
+        phases++;
+    }
+
+    matching.clear();
+    for (size_t u = 0; u < n_left; u++)
+    {
+        if (match_left[u] != -1)
+        {
+            matching.push_back(make_pair(instance.left[u], instance.right[match_left[u]]));
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file matching.hpp
+ *
+ * @brief A Hopcroft-Karp fast path for maxflow problems which
+ *        are really unit-capacity bipartite matchings.
+ *
+ * Such a problem has a source whose edges all go to a set of
+ * "left" nodes, a sink whose edges all come from a set of
+ * "right" nodes, and every other edge going from left to right,
+ * all with capacity 1. Its max flow is the size of a maximum
+ * matching, which Hopcroft-Karp finds in O(e sqrt(n)) instead of
+ * the O(n e^2) of Edmonds-Karp.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef MATCHING_HPP
+#define MATCHING_HPP
+
+#include "maxflow.hpp"
+#include <utility>
+
+/**
+ * @struct bipartite_instance
+ * @brief A unit-capacity bipartite problem in compressed sparse
+ *        row form
+ *
+ * @var bipartite_instance::left
+ * The graph index of each left node
+ * @var bipartite_instance::right
+ * The graph index of each right node
+ * @var bipartite_instance::offsets
+ * Left node i's edges are targets[offsets[i]] up to (but not
+ * including) targets[offsets[i + 1]]
+ * @var bipartite_instance::targets
+ * The right node (as a position in `right`) of every edge
+ */
+struct bipartite_instance
+{
+    std::vector<int> left, right;
+    std::vector<int> offsets, targets;
+};
+
+/**
+ * @brief Checks whether a maxflow problem is a unit-capacity
+ *        bipartite matching and, if so, builds its compact form.
+ *        Takes time proportional to the size of the graph.
+ *
+ * @param on The capacity graph
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param out Replaced by the instance if one is detected
+ *
+ * @return True if the problem is a bipartite matching
+ */
+bool detect_bipartite_matching(const graph &on, const int &s, const int &t, bipartite_instance &out);
+
+/**
+ * @brief Finds a maximum matching using Hopcroft-Karp
+ *
+ * @param instance The bipartite problem to solve
+ * @param matching Replaced by the matched (left, right) pairs,
+ *        as graph indices, in order of left node
+ * @param phases Replaced by the number of BFS phases
+ *
+ * @return The size of the matching, which is the max flow
+ */
+int hopcroft_karp(const bipartite_instance &instance, std::vector<std::pair<int, int>> &matching, int &phases);
+
+#endif
@@ -1,7 +1,13 @@
 #include "maxflow.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <climits>
+#include <string>
+
+using namespace std;
 
 // Recursive internal
-vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t, set<int> &used);
+static vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t, node_bitset &used);
 
 ////////////////////////////////////////////////////////////////
 // IO operations
@@ -99,6 +105,8 @@ void save_graph(graph &to_save, ostream &strm)
 
 // Return the net flow across a path
 // Takes time proportional to the length of the path
+// The first edge always counts; after it, only positive
+// (forwards) weights can lower the minimum
 int path_flow(const vector<edge> &path)
 {
     if (path.size() == 0)
@@ -107,32 +115,34 @@ int path_flow(const vector<edge> &path)
     }
 
     int min = path[0].weight;
+    int rest = kernels().min_positive_weight(path.data() + 1, path.size() - 1);
 
-    for (int i = 1; i < path.size(); i++)
-    {
-        if (path[i].weight < min && path[i].weight > 0)
-        {
-            min = path[i].weight;
-        }
-    }
-
-    return min;
+    return (rest < min) ? rest : min;
 }
 
 // Returns a valid path from the source to the sink
 vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t)
 {
-    set<int> used = {s};
-    return get_path(residual, capacities, s, t, used);
+    search_workspace workspace;
+    return get_path(residual, capacities, s, t, workspace);
+}
+
+// Returns a valid path from the source to the sink, reusing the
+// workspace's visited bitset
+vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t, search_workspace &workspace)
+{
+    workspace.prepare(residual);
+    workspace.visited.set(s);
+    return get_path(residual, capacities, s, t, workspace.visited);
 }
 
 // Recursive internal
-vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t, set<int> &used)
+static vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t, node_bitset &used)
 {
     // Iterate over options at this point
     // cout << "On node " << s << " looking for " << t << '\n';
 
-    used.insert(s);
+    used.set(s);
 
     // Forward edges
     for (auto &item : residual.nodes[s].edges)
@@ -152,7 +162,7 @@ vector<edge> get_path(graph &residual, graph &capacities, const int &s, const in
             return out;
         }
 
-        else if (used.count(item.first) != 0)
+        else if (used.test(item.first))
         {
             continue;
         }
@@ -187,7 +197,7 @@ vector<edge> get_path(graph &residual, graph &capacities, const int &s, const in
             continue;
         }
 
-        else if (used.count(from) != 0)
+        else if (used.test(from))
         {
             continue;
         }
@@ -214,84 +224,324 @@ vector<edge> get_path(graph &residual, graph &capacities, const int &s, const in
     return vector<edge>();
 }
 
-// Get the shorted valid augmenting path using breadth first search
-// of the residual graph. Not recursive.
-vector<edge> get_path_bfs(graph &residual, graph &capacities, const int &s, const int &t)
+// BFS tuning, from Beamer et al. "Direction-Optimizing
+// Breadth-First Search": go bottom-up once the frontier's edges
+// outnumber the unexplored ones / ALPHA, and back top-down once
+// the frontier holds fewer than n / BETA nodes.
+static const long long BFS_ALPHA = 14;
+static const long long BFS_BETA = 24;
+
+// The number of edges touching a node, in either direction
+static inline long long degree(const graph_node &node)
 {
-    // source_index[i] is the node which led to i
-    // If a node is not yet visited by bfs, it will have nothing
-    map<int, int> source_index;
-    queue<int> to_search;
+    return node.edges.size() + node.nodes_having_backwards_edges.size();
+}
+
+void search_workspace::prepare(const graph &on)
+{
+    if (visited.bits != on.nodes.size())
+    {
+        visited.resize(on.nodes.size());
+        frontier_bits.resize(on.nodes.size());
+        targets.resize(on.nodes.size());
+        parent.resize(on.nodes.size());
 
-    to_search.push(s);
+        total_degree = 0;
+        for (const auto &node : on.nodes)
+        {
+            total_degree += degree(node);
+        }
+    }
+    else
+    {
+        visited.clear();
+    }
+
+    frontier.clear();
+    next.clear();
+}
+
+// Expands every frontier node into `next`. Returns the first
+// target reached, or -1.
+static int bfs_top_down(const graph &residual, graph &capacities, search_workspace &ws)
+{
+    auto &scratch = ws.scratch;
 
-    while (true)
+    for (const int &cur : ws.frontier)
     {
-        if (to_search.empty())
+        const graph_node &node = residual.nodes[cur];
+        if (scratch.size() < (size_t)degree(node))
         {
-            // Failure case; Halt algorithm
-            return vector<edge>{};
+            scratch.resize(degree(node));
         }
-        else if (to_search.front() == t)
+
+        // Forwards edges with remaining capacity
+        size_t count = 0;
+        for (const auto &p : node.edges)
         {
-            // Success case; Break from loop
-            break;
+            scratch[count] = p.first;
+            count += (p.second > 0);
         }
-        else
+
+        // Backwards edges with flow to cancel
+        for (const auto &from : node.nodes_having_backwards_edges)
         {
-            // Regular case; Iterate over links
-            int cur = to_search.front();
-            to_search.pop();
+            scratch[count] = from;
+            count += (residual.nodes[from].edges.at(cur) < capacities.nodes[from].edges[cur]);
+        }
 
-            // Forwards edges
-            for (const auto &p : residual.nodes[cur].edges)
+        // A node can be both a forwards and a backwards neighbor,
+        // so mark as we go rather than trusting the filter alone
+        count = kernels().filter_unvisited(scratch.data(), count, ws.visited.words.data(), scratch.data());
+        for (size_t i = 0; i < count; i++)
+        {
+            int neighbor = scratch[i];
+            if (ws.visited.test(neighbor))
             {
-                if (source_index.count(p.first) == 0 && residual.nodes[cur].edges[p.first] > 0)
+                continue;
+            }
+
+            ws.visited.set(neighbor);
+            ws.parent[neighbor] = cur;
+            ws.next.push_back(neighbor);
+
+            if (ws.targets.test(neighbor))
+            {
+                return neighbor;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// Scans the unvisited nodes a word at a time, adopting the first
+// frontier node found as a parent. Returns the first target
+// reached, or -1.
+static int bfs_bottom_up(const graph &residual, graph &capacities, search_workspace &ws)
+{
+    for (const int &cur : ws.frontier)
+    {
+        ws.frontier_bits.set(cur);
+    }
+
+    int found = -1;
+    for (size_t w = 0; w < ws.visited.words.size() && found == -1; w++)
+    {
+        uint64_t todo = ~ws.visited.words[w] & ws.visited.mask(w);
+        uint64_t reached = 0;
+
+        while (todo != 0)
+        {
+            int bit = __builtin_ctzll(todo);
+            int cur = (int)(w * 64 + bit);
+            const graph_node &node = residual.nodes[cur];
+            int from = -1;
+            todo &= todo - 1;
+
+            // Forwards edges into cur with remaining capacity
+            for (const auto &prev : node.nodes_having_backwards_edges)
+            {
+                if (ws.frontier_bits.test(prev) && residual.nodes[prev].edges.at(cur) > 0)
+                {
+                    from = prev;
+                    break;
+                }
+            }
+
+            // Backwards over edges out of cur which carry flow
+            if (from == -1)
+            {
+                for (const auto &p : node.edges)
                 {
-                    source_index[p.first] = cur;
-                    to_search.push(p.first);
+                    if (ws.frontier_bits.test(p.first) && p.second < capacities.nodes[cur].edges[p.first])
+                    {
+                        from = p.first;
+                        break;
+                    }
                 }
             }
 
-            // Backwards edges
-            for (const auto &from : residual.nodes[cur].nodes_having_backwards_edges)
+            if (from != -1)
             {
-                if (source_index.count(from) == 0 &&
-                    residual.nodes[from].edges[cur] < capacities.nodes[from].edges[cur])
+                reached |= (uint64_t)1 << bit;
+                ws.parent[cur] = from;
+                ws.next.push_back(cur);
+
+                if (ws.targets.test(cur))
                 {
-                    source_index[from] = cur;
-                    to_search.push(from);
+                    found = cur;
+                    break;
                 }
             }
         }
+
+        // Nodes reached this level must not act as parents until
+        // the next one, so they join `visited` after the word
+        ws.visited.words[w] |= reached;
+    }
+
+    for (const int &cur : ws.frontier)
+    {
+        ws.frontier_bits.reset(cur);
     }
 
-    // Success case here
-    // Reconstruct shortest path into vector
+    return found;
+}
+
+// Runs the level-synchronous, direction-optimizing BFS outward
+// from the nodes already in ws.frontier (which must be marked
+// visited, with a parent of -1) until it reaches a node in
+// ws.targets. Returns that node, or -1 if none is reachable.
+static int bfs_to_targets(const graph &residual, graph &capacities, search_workspace &ws)
+{
+    long long frontier_degree = 0;
+    for (const int &cur : ws.frontier)
+    {
+        frontier_degree += degree(residual.nodes[cur]);
+    }
+
+    long long unexplored = ws.total_degree - frontier_degree;
+    bool bottom_up = false;
+    int found = -1;
+
+    while (found == -1)
+    {
+        if (ws.frontier.empty())
+        {
+            // Failure case; Halt algorithm
+            return -1;
+        }
+
+        if (!bottom_up && frontier_degree > unexplored / BFS_ALPHA)
+        {
+            bottom_up = true;
+        }
+        else if (bottom_up && (long long)ws.frontier.size() < (long long)residual.nodes.size() / BFS_BETA)
+        {
+            bottom_up = false;
+        }
+
+        if (bottom_up)
+        {
+            found = bfs_bottom_up(residual, capacities, ws);
+        }
+        else
+        {
+            found = bfs_top_down(residual, capacities, ws);
+        }
+
+        frontier_degree = 0;
+        for (const int &cur : ws.next)
+        {
+            frontier_degree += degree(residual.nodes[cur]);
+        }
+        unexplored -= frontier_degree;
+
+        swap(ws.frontier, ws.next);
+        ws.next.clear();
+    }
+
+    return found;
+}
+
+// Reconstructs the path the BFS found to `target` by following
+// parents back to a root. Replaces `root` with that root.
+static vector<edge> trace_path(const graph &residual, const search_workspace &ws, const int &target, int &root)
+{
     vector<edge> out;
-    int position = t, from;
-    while (position != s)
+    int position = target, from;
+
+    while (ws.parent[position] != -1)
     {
-        from = source_index[position];
+        from = ws.parent[position];
 
-        // Forwards edge
-        if (residual.nodes[from].edges.count(position) != 0)
+        // Forwards edge. The search never crosses an empty forwards
+        // edge, so if one exists here the step was backwards over
+        // an antiparallel edge.
+        auto it = residual.nodes[from].edges.find(position);
+        if (it != residual.nodes[from].edges.end() && it->second > 0)
         {
-            out.insert(out.begin(), edge{position, residual.nodes[from].edges[position]});
+            out.push_back(edge{position, it->second});
         }
 
         // Backwards edge
         else
         {
-            out.insert(out.begin(), edge{position, 0});
+            out.push_back(edge{position, 0});
         }
 
         position = from;
     }
 
+    root = position;
+    reverse(out.begin(), out.end());
     return out;
 }
 
+// Get the shorted valid augmenting path using breadth first search
+// of the residual graph. Not recursive.
+vector<edge> get_path_bfs(const graph &residual, graph &capacities, const int &s, const int &t)
+{
+    search_workspace workspace;
+    return get_path_bfs(residual, capacities, s, t, workspace);
+}
+
+// Single-source, single-target version which reuses the
+// workspace between calls
+vector<edge> get_path_bfs(const graph &residual, graph &capacities, const int &s, const int &t,
+                          search_workspace &workspace)
+{
+    search_workspace &ws = workspace;
+    ws.prepare(residual);
+
+    if (s == t)
+    {
+        return vector<edge>{};
+    }
+
+    ws.visited.set(s);
+    ws.parent[s] = -1;
+    ws.frontier.push_back(s);
+
+    ws.targets.set(t);
+    int found = bfs_to_targets(residual, capacities, ws);
+    ws.targets.reset(t);
+
+    if (found == -1)
+    {
+        return vector<edge>{};
+    }
+
+    int root;
+    return trace_path(residual, ws, found, root);
+}
+
+// Returns the shortest augmenting path from any of `sources` to
+// any node set in workspace.targets. Replaces `from` and `to`
+// with the ends of the path.
+static vector<edge> get_multi_terminal_path(const graph &residual, graph &capacities, const vector<int> &sources,
+                                            search_workspace &workspace, int &from, int &to)
+{
+    search_workspace &ws = workspace;
+    ws.prepare(residual);
+
+    for (const int &s : sources)
+    {
+        ws.visited.set(s);
+        ws.parent[s] = -1;
+        ws.frontier.push_back(s);
+    }
+
+    to = bfs_to_targets(residual, capacities, ws);
+    if (to == -1)
+    {
+        return vector<edge>{};
+    }
+
+    return trace_path(residual, ws, to, from);
+}
+
 // Returns a zero graph in the shape of the one passed
 // Takes time proportional to the number of edges in the input
 graph zero_graph(const graph &capacities)
@@ -309,22 +559,22 @@ graph zero_graph(const graph &capacities)
     return out;
 }
 
-// Adds an augmenting path into a flow graph
+// Adds a given amount of flow along an augmenting path
 // Takes time proportional to the size of the path
-void add_augmenting_path(const vector<edge> &path, graph &flow, const int &s)
+void add_augmenting_path(const vector<edge> &path, graph &flow, const int &s, const int &net_flow)
 {
     if (path.size() == 0)
     {
         return;
     }
 
-    int net_flow = path_flow(path);
     int position = s;
 
     for (const auto &p : path)
     {
-        // Forwards edge
-        if (flow.nodes[position].edges.count(p.to) != 0)
+        // Forwards edge (paths mark backwards edges with a zero
+        // weight, which also tells antiparallel edges apart)
+        if (p.weight > 0 && flow.nodes[position].edges.count(p.to) != 0)
         {
             flow.nodes[position].edges[p.to] += net_flow;
         }
@@ -339,22 +589,23 @@ void add_augmenting_path(const vector<edge> &path, graph &flow, const int &s)
     }
 }
 
-// Like add_augmenting_path, but for a residual graph
+// Like add_augmenting_path with an explicit amount, but for a
+// residual graph
 // Runs in time proportional to the length of the path
-void subtract_augmenting_path(const vector<edge> &path, graph &residuals, const int &s)
+void subtract_augmenting_path(const vector<edge> &path, graph &residuals, const int &s, const int &net_flow)
 {
     if (path.size() == 0)
     {
         return;
     }
 
-    int net_flow = path_flow(path);
     int position = s;
 
     for (const auto &p : path)
     {
-        // Forwards edge
-        if (residuals.nodes[position].edges.count(p.to))
+        // Forwards edge (paths mark backwards edges with a zero
+        // weight, which also tells antiparallel edges apart)
+        if (p.weight > 0 && residuals.nodes[position].edges.count(p.to))
         {
             residuals.nodes[position].edges[p.to] -= net_flow;
         }
@@ -369,77 +620,350 @@ void subtract_augmenting_path(const vector<edge> &path, graph &residuals, const
     }
 }
 
+// The most flow a path from `root` can carry, given the current
+// residuals: the remaining capacity of each forwards edge, and
+// the flow already on each backwards one. Forwards steps carry
+// their residual as a positive weight, so their minimum is one
+// pass of the vector kernel; only the backwards steps (weight 0)
+// need looking up.
+static int residual_bottleneck(const vector<edge> &path, const graph &residual, const graph &capacities,
+                               const int &root)
+{
+    int out = kernels().min_positive_weight(path.data(), path.size());
+    int position = root;
+
+    for (const auto &p : path)
+    {
+        if (p.weight == 0)
+        {
+            int available = capacities.nodes[p.to].edges.at(position) - residual.nodes[p.to].edges.at(position);
+            out = (available < out) ? available : out;
+        }
+
+        position = p.to;
+    }
+
+    return out;
+}
+
 ////////////////////////////////////////////////////////////////
 // Actual routines
 ////////////////////////////////////////////////////////////////
 
+// Whether a solver should stop before its next search. If so,
+// records why in `result`.
+static bool out_of_budget(const solver_options &options, const chrono::steady_clock::time_point &start,
+                          flow_result &result)
+{
+    if (result.flow >= options.target_flow)
+    {
+        result.reason = stop_reason::target_reached;
+    }
+    else if (result.iterations >= options.max_iterations)
+    {
+        result.reason = stop_reason::iteration_budget;
+    }
+    else if (options.time_budget != chrono::nanoseconds::max() &&
+             chrono::steady_clock::now() - start >= options.time_budget)
+    {
+        result.reason = stop_reason::time_budget;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// An upper bound on the maxflow, given a flow of `flow` so far:
+// that flow plus the residual capacity of some s-t cut. A BFS of
+// the residual graph from s puts every node in a level, and the
+// first k levels form a cut for each k below t's level. Residual
+// edges only go down at most one level, so each edge crosses at
+// most one of those cuts, and one pass sums them all.
+// Takes time proportional to the number of edges.
+static long long cut_upper_bound(const graph &residual, const graph &capacities, const int &s, const int &t,
+                                 const int &flow)
+{
+    vector<int> level(residual.nodes.size(), -1), order;
+
+    level[s] = 0;
+    order.push_back(s);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        int cur = order[i];
+
+        for (const auto &p : residual.nodes[cur].edges)
+        {
+            if (p.second > 0 && level[p.first] == -1)
+            {
+                level[p.first] = level[cur] + 1;
+                order.push_back(p.first);
+            }
+        }
+        for (const auto &from : residual.nodes[cur].nodes_having_backwards_edges)
+        {
+            if (level[from] == -1 && residual.nodes[from].edges.at(cur) < capacities.nodes[from].edges.at(cur))
+            {
+                level[from] = level[cur] + 1;
+                order.push_back(from);
+            }
+        }
+    }
+
+    // No augmenting path left: the reachable nodes form a cut
+    // with no residual capacity at all
+    if (level[t] == -1)
+    {
+        return flow;
+    }
+
+    // crossing[k] is the residual capacity leaving levels 0 to k
+    vector<long long> crossing(level[t], 0);
+    for (const int &cur : order)
+    {
+        if (level[cur] >= level[t])
+        {
+            continue;
+        }
+
+        for (const auto &p : residual.nodes[cur].edges)
+        {
+            if (p.second > 0 && level[p.first] == level[cur] + 1)
+            {
+                crossing[level[cur]] += p.second;
+            }
+        }
+        for (const auto &from : residual.nodes[cur].nodes_having_backwards_edges)
+        {
+            if (level[from] == level[cur] + 1)
+            {
+                crossing[level[cur]] +=
+                    capacities.nodes[from].edges.at(cur) - residual.nodes[from].edges.at(cur);
+            }
+        }
+    }
+
+    return flow + *min_element(crossing.begin(), crossing.end());
+}
+
 // Returns the maxflow of a given graph
 // using the Ford-Fulkerson algorithm
+int ford_fulkerson(graph &capacities, const int &s, const int &t, int &iterations, const bool &verbose)
+{
+    flow_result result = ford_fulkerson(capacities, s, t, solver_options{}, verbose);
+    iterations = result.iterations;
+    return result.flow;
+}
+
+// Ford-Fulkerson, stopping when `options` says to
 // n := number NODES, e := number EDGES, f := max flow,
 // p := number augmenting paths
 // O(e + 3*p*len(path) + e) = O(2e + 3pl) ~ O(pe)
-int ford_fulkerson(graph &capacities, const int &s, const int &t, int &iterations)
+flow_result ford_fulkerson(graph &capacities, const int &s, const int &t, const solver_options &options,
+                           const bool &verbose)
 {
+    auto start = chrono::steady_clock::now();
     vector<edge> path;
     graph flow, residual;
-    int out = 0;
+    search_workspace workspace;
+    flow_result out;
+    int net_flow;
 
-    iterations = 0;
     flow = zero_graph(capacities); // O(e)
     residual = capacities;
 
     // While a augmenting path exists
-    // int total_path_length = 0;
-    do // do p times
+    while (!out_of_budget(options, start, out)) // do p times
     {
         // Get augmenting path
-        path = get_path(residual, capacities, s, t); // O(len(path)), worst case e
-        out += path_flow(path);
+        path = get_path(residual, capacities, s, t, workspace); // O(len(path)), worst case e
+        net_flow = path.empty() ? 0 : residual_bottleneck(path, residual, capacities, s); // O(len(path))
+        out.flow += net_flow;
 
-        cout << "FF is on iteration " << iterations << "\t w/ flow " << out << '\n';
+        if (verbose)
+        {
+            cout << "FF is on iteration " << out.iterations << "\t w/ flow " << out.flow << '\n';
+        }
 
         // Add augmenting path to flow
-        add_augmenting_path(path, flow, s); // O(len(path))
+        add_augmenting_path(path, flow, s, net_flow); // O(len(path))
 
         // Recompute residual
-        subtract_augmenting_path(path, residual, s); // O(len(path))
-        iterations++;
+        subtract_augmenting_path(path, residual, s, net_flow); // O(len(path))
+        out.iterations++;
 
-    } while (path.size() > 0);
+        if (path.size() == 0)
+        {
+            out.reason = stop_reason::completed;
+            break;
+        }
+    }
 
+    out.upper_bound =
+        (out.reason == stop_reason::completed) ? out.flow : cut_upper_bound(residual, capacities, s, t, out.flow);
     return out;
 }
 
 // Returns the maxflow of a given graph
 // using the Edmonds Karp algorithm
-int edmonds_karp(graph &capacities, const int &s, const int &t, int &iterations)
+int edmonds_karp(graph &capacities, const int &s, const int &t, int &iterations, const bool &verbose)
+{
+    flow_result result = edmonds_karp(capacities, s, t, solver_options{}, verbose);
+    iterations = result.iterations;
+    return result.flow;
+}
+
+// Edmonds Karp, stopping when `options` says to
+flow_result edmonds_karp(graph &capacities, const int &s, const int &t, const solver_options &options,
+                         const bool &verbose)
 {
+    auto start = chrono::steady_clock::now();
     vector<edge> path;
     graph flow, residual;
-    int out = 0;
+    search_workspace workspace;
+    flow_result out;
+    int net_flow;
 
-    iterations = 0;
     flow = zero_graph(capacities); // O(e)
     residual = capacities;
 
     // While a augmenting path exists
-    // int total_path_length = 0;
-    do // do p times
+    while (!out_of_budget(options, start, out)) // do p times
     {
         // Get augmenting path via breadth first search
-        path = get_path_bfs(residual, capacities, s, t); // O(len(path))
-        out += path_flow(path);
+        path = get_path_bfs(residual, capacities, s, t, workspace); // O(len(path))
+        net_flow = path.empty() ? 0 : residual_bottleneck(path, residual, capacities, s); // O(len(path))
+        out.flow += net_flow;
 
-        cout << "EK is on iteration " << iterations << "\t w/ flow " << out << '\n';
+        if (verbose)
+        {
+            cout << "EK is on iteration " << out.iterations << "\t w/ flow " << out.flow << '\n';
+        }
 
         // Add augmenting path to flow
-        add_augmenting_path(path, flow, s); // O(len(path))
+        add_augmenting_path(path, flow, s, net_flow); // O(len(path))
 
         // Recompute residual
-        subtract_augmenting_path(path, residual, s); // O(len(path))
+        subtract_augmenting_path(path, residual, s, net_flow); // O(len(path))
+        out.iterations++;
+
+        if (path.size() == 0)
+        {
+            out.reason = stop_reason::completed;
+            break;
+        }
+    }
+
+    out.upper_bound =
+        (out.reason == stop_reason::completed) ? out.flow : cut_upper_bound(residual, capacities, s, t, out.flow);
+    return out;
+}
+
+// Returns the maxflow from a set of sources to a set of sinks
+// using Edmonds-Karp with a multi-source BFS. Each source acts as
+// if fed by its own edge of capacity `limit`, and each sink as if
+// draining into one, without adding those edges to the graph.
+int multi_terminal_maxflow(graph &capacities, const vector<terminal> &sources, const vector<terminal> &sinks,
+                           int &iterations, const bool &verbose)
+{
+    graph residual = capacities;
+    search_workspace workspace;
+    vector<int> supply(capacities.nodes.size(), 0), demand(capacities.nodes.size(), 0);
+    vector<int> active;
+    int out = 0;
+
+    // Checked here as well as by callers: a node which is both a
+    // source and a sink would be a path of length zero
+    vector<bool> is_source(capacities.nodes.size(), false);
+    auto check = [&capacities](const terminal &term) {
+        if (term.node < 0 || (size_t)term.node >= capacities.nodes.size())
+        {
+            throw runtime_error("multi_terminal_maxflow: node " + to_string(term.node) + " is not in the graph");
+        }
+    };
+    for (const auto &source : sources)
+    {
+        check(source);
+        is_source[source.node] = true;
+    }
+    for (const auto &sink : sinks)
+    {
+        check(sink);
+        if (is_source[sink.node])
+        {
+            throw runtime_error("multi_terminal_maxflow: node " + to_string(sink.node) +
+                                " is both a source and a sink");
+        }
+    }
+
+    iterations = 0;
+    workspace.prepare(residual);
+
+    // Repeated terminals pool their limits
+    for (const auto &source : sources)
+    {
+        supply[source.node] = saturating_add(supply[source.node], source.limit);
+    }
+    for (const auto &sink : sinks)
+    {
+        demand[sink.node] = saturating_add(demand[sink.node], sink.limit);
+    }
+
+    for (const auto &source : sources)
+    {
+        if (supply[source.node] > 0)
+        {
+            active.push_back(source.node);
+        }
+    }
+    sort(active.begin(), active.end());
+    active.erase(unique(active.begin(), active.end()), active.end());
+    for (const auto &sink : sinks)
+    {
+        if (demand[sink.node] > 0)
+        {
+            workspace.targets.set(sink.node);
+        }
+    }
+
+    while (!active.empty())
+    {
+        int from, to;
+        vector<edge> path = get_multi_terminal_path(residual, capacities, active, workspace, from, to);
+
+        if (path.size() == 0)
+        {
+            break;
+        }
+
+        int net_flow = residual_bottleneck(path, residual, capacities, from);
+        net_flow = (supply[from] < net_flow) ? supply[from] : net_flow;
+        net_flow = (demand[to] < net_flow) ? demand[to] : net_flow;
+
+        subtract_augmenting_path(path, residual, from, net_flow);
+        out = saturating_add(out, net_flow);
         iterations++;
 
-    } while (path.size() > 0);
+        if (verbose)
+        {
+            cout << "MT is on iteration " << iterations << "\t w/ flow " << out << '\n';
+        }
+
+        // Retire exhausted terminals
+        supply[from] -= net_flow;
+        demand[to] -= net_flow;
+
+        if (supply[from] == 0)
+        {
+            active.erase(find(active.begin(), active.end(), from));
+        }
+        if (demand[to] == 0)
+        {
+            workspace.targets.reset(to);
+        }
+    }
 
     return out;
 }
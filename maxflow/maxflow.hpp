@@ -17,12 +17,27 @@
 #ifndef MAXFLOW_HPP
 #define MAXFLOW_HPP
 
+#include "node_bitset.hpp"
+#include <chrono>
+#include <climits>
 #include <iostream>
 #include <map>
 #include <queue>
 #include <set>
+#include <stdexcept>
 #include <vector>
-using namespace std;
+
+/**
+ * @brief The ordered map each node keeps its edges in. Building
+ *        with -DMAXFLOW_RBTREE_EDGES (make RBTREE_EDGES=1) swaps
+ *        std::map for the pooled RBTree from ../red-black-tree.
+ */
+#ifdef MAXFLOW_RBTREE_EDGES
+#include "rbtree.hpp"
+typedef RBTree<int, int> edge_map;
+#else
+typedef std::map<int, int> edge_map;
+#endif
 
 /**
  * @struct edge
@@ -52,10 +67,36 @@ struct edge
  */
 struct graph_node
 {
-    map<int, int> edges;
-    set<int> nodes_having_backwards_edges;
+    edge_map edges;
+    std::set<int> nodes_having_backwards_edges;
+};
+
+/**
+ * @struct terminal
+ * @brief A source or sink of a multi-terminal flow problem
+ *
+ * @var terminal::node
+ * The index of the node
+ *
+ * @var terminal::limit
+ * The most flow this terminal may supply (as a source) or
+ * absorb (as a sink). Unlimited by default.
+ */
+struct terminal
+{
+    int node;
+    int limit = INT_MAX;
 };
 
+/**
+ * @brief Returns a + b for non-negative flows, saturating at
+ *        `INT_MAX` rather than overflowing
+ */
+inline int saturating_add(const int &a, const int &b)
+{
+    return (a > INT_MAX - b) ? INT_MAX : a + b;
+}
+
 // A graph of graph_nodes
 /**
  * @struct graph
@@ -67,7 +108,49 @@ struct graph_node
 struct graph
 {
     // vector of all nodes
-    vector<graph_node> nodes;
+    std::vector<graph_node> nodes;
+};
+
+/**
+ * @struct search_workspace
+ * @brief Scratch space for the augmenting path searches. A
+ *        solver keeps one for its whole run so that each
+ *        search only clears a bitmap instead of allocating
+ *        per node. Must only be reused on graphs of the same
+ *        shape.
+ *
+ * @var search_workspace::visited
+ * The nodes already reached by the current search
+ * @var search_workspace::frontier_bits
+ * The current BFS level, as a bitset, for bottom-up steps
+ * @var search_workspace::targets
+ * The nodes a BFS stops at. Unlike the rest of the workspace,
+ * this is kept between searches (but not across a resize).
+ * @var search_workspace::parent
+ * parent[i] is the node which led to i; only meaningful where
+ * `visited` is set
+ * @var search_workspace::frontier
+ * The current BFS level, as a list, for top-down steps
+ * @var search_workspace::next
+ * The BFS level being built
+ * @var search_workspace::scratch
+ * Candidate neighbors of one node, filtered against `visited`
+ * @var search_workspace::total_degree
+ * The sum of in- and out-degrees over all nodes
+ */
+struct search_workspace
+{
+    node_bitset visited, frontier_bits, targets;
+    std::vector<int> parent, frontier, next, scratch;
+    long long total_degree = 0;
+
+    /**
+     * @brief Readies the workspace for a search on `on`,
+     *        resizing it if `on` has a different node count
+     *
+     * @param on The graph about to be searched
+     */
+    void prepare(const graph &on);
 };
 
 /**
@@ -76,7 +159,7 @@ struct graph
  * @param strm The stream to write debugging output to
  * @param what The graph to output to the stream
  */
-ostream &operator<<(ostream &strm, graph &what);
+std::ostream &operator<<(std::ostream &strm, graph &what);
 
 /**
  * @brief Loads a graph from an input stream
@@ -85,7 +168,7 @@ ostream &operator<<(ostream &strm, graph &what);
  *
  * @return The loaded graph
  */
-graph load_graph(istream &strm);
+graph load_graph(std::istream &strm);
 
 // Saves (or outputs) a graph to an output stream (cout, cerr,
 // or file)
@@ -96,7 +179,7 @@ graph load_graph(istream &strm);
  * @param to_save The graph to save
  * @param strm The stream to output `to_save` to
  */
-void save_graph(graph &to_save, ostream &strm);
+void save_graph(graph &to_save, std::ostream &strm);
 
 /**
  * @brief Creates a zero graph in the shape of the passed graph
@@ -107,22 +190,26 @@ void save_graph(graph &to_save, ostream &strm);
 graph zero_graph(const graph &capacities);
 
 /**
- * @brief Adds an augmenting path into a flow graph
+ * @brief Adds a given amount of flow along an augmenting path
+ *        into a flow graph
  *
  * @param path The augmenting path to add
  * @param flow The flow graph to modify
  * @param s The index of the starting node
+ * @param net_flow The amount of flow to add
  */
-void add_augmenting_path(const vector<edge> &path, graph &flow, const int &s);
+void add_augmenting_path(const std::vector<edge> &path, graph &flow, const int &s, const int &net_flow);
 
 /**
- * @brief Subtracts an augmenting path from a residual graph
+ * @brief Subtracts a given amount of flow along an augmenting
+ *        path from a residual graph
  *
  * @param path The augmenting path to subtract
  * @param residuals The residual graph to modify
  * @param s The index of the starting node
+ * @param net_flow The amount of flow to subtract
  */
-void subtract_augmenting_path(const vector<edge> &path, graph &residuals, const int &s);
+void subtract_augmenting_path(const std::vector<edge> &path, graph &residuals, const int &s, const int &net_flow);
 
 /**
  * @brief Returns the first valid augmenting path from the
@@ -136,7 +223,22 @@ void subtract_augmenting_path(const vector<edge> &path, graph &residuals, const
  * @return A vector of edges representing a valid augmenting
  *         path
  */
-vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t);
+std::vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t);
+
+/**
+ * @brief Like `get_path`, but reuses the visited bitset of
+ *        `workspace` instead of allocating one.
+ *
+ * @param residual The residual (remaining unused flow) graph
+ * @param capacities The capacity graph
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param workspace Scratch space sized for `residual`
+ *
+ * @return A vector of edges representing a valid augmenting
+ *         path
+ */
+std::vector<edge> get_path(graph &residual, graph &capacities, const int &s, const int &t, search_workspace &workspace);
 
 /**
  * @brief Returns the shorted valid augmenting path from the
@@ -150,16 +252,99 @@ vector<edge> get_path(graph &residual, graph &capacities, const int &s, const in
  * @return A vector of edges representing the shortest valid
  *         augmenting path
  */
-vector<edge> get_path_bfs(const graph &residual, graph &capacities, const int &s, const int &t);
+std::vector<edge> get_path_bfs(const graph &residual, graph &capacities, const int &s, const int &t);
 
 /**
- * @brief Gets the net flow along an augmenting path
+ * @brief Like `get_path_bfs`, but reuses `workspace` instead of
+ *        allocating. Switches between top-down levels (expand
+ *        each frontier node) and bottom-up levels (scan the
+ *        unvisited nodes 64 to a word for a parent in the
+ *        frontier) depending on which touches fewer edges.
+ *
+ * @param residual The residual (remaining unused flow) graph
+ * @param capacities The capacity graph
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param workspace Scratch space sized for `residual`
+ *
+ * @return A vector of edges representing the shortest valid
+ *         augmenting path
+ */
+std::vector<edge> get_path_bfs(const graph &residual, graph &capacities, const int &s, const int &t,
+                               search_workspace &workspace);
+
+/**
+ * @brief Gets the net flow along an augmenting path, counting
+ *        only its forwards edges. Backwards steps carry a zero
+ *        weight, so the flow they may cancel is not seen here;
+ *        solvers limit those with the residual graph instead.
  *
  * @param path The path in question
  *
- * @return The minimal (net) flow across the path
+ * @return The minimal (net) flow across the path's forwards
+ *         edges
+ */
+int path_flow(const std::vector<edge> &path);
+
+/**
+ * @enum stop_reason
+ * @brief Why a solver stopped
  */
-int path_flow(const vector<edge> &path);
+enum class stop_reason
+{
+    completed,
+    target_reached,
+    iteration_budget,
+    time_budget
+};
+
+/**
+ * @struct solver_options
+ * @brief Limits under which `ford_fulkerson` and `edmonds_karp`
+ *        may stop before the flow is maximal. Each is checked
+ *        before every search; the defaults never stop early.
+ *
+ * @var solver_options::target_flow
+ * Stop once the flow is at least this much
+ * @var solver_options::max_iterations
+ * Stop after this many searches
+ * @var solver_options::time_budget
+ * Stop once this much wall-clock time has passed. A search in
+ * progress is finished first, so the overrun is at most one
+ * search.
+ */
+struct solver_options
+{
+    int target_flow = INT_MAX;
+    int max_iterations = INT_MAX;
+    std::chrono::nanoseconds time_budget = std::chrono::nanoseconds::max();
+};
+
+/**
+ * @struct flow_result
+ * @brief What a solver run with `solver_options` found
+ *
+ * @var flow_result::flow
+ * The flow found, which is the maxflow if `reason` is
+ * `completed`, and a lower bound on it otherwise
+ * @var flow_result::upper_bound
+ * An upper bound on the maxflow: `flow` plus the least residual
+ * capacity of the s-side cuts formed by the levels of a BFS of
+ * the residual graph. Equal to `flow` when no augmenting path
+ * is left, however the run stopped.
+ * @var flow_result::iterations
+ * The number of searches made, counting a final one which found
+ * no path
+ * @var flow_result::reason
+ * Why the solver stopped
+ */
+struct flow_result
+{
+    int flow = 0;
+    long long upper_bound = 0;
+    int iterations = 0;
+    stop_reason reason = stop_reason::completed;
+};
 
 /**
  * @brief Returns the maxflow of a given graph using the
@@ -169,10 +354,27 @@ int path_flow(const vector<edge> &path);
  * @param s The index of the starting node
  * @param t The index of the ending node
  * @param iterations Replaced by the number of iterations
+ * @param verbose Whether to log each iteration to `cout`
  *
  * @return The max flow across the graph from `s` to `t`
  */
-int ford_fulkerson(graph &on, const int &s, const int &t, int &iterations);
+int ford_fulkerson(graph &on, const int &s, const int &t, int &iterations, const bool &verbose = true);
+
+/**
+ * @brief Like `ford_fulkerson`, but stops early when `options`
+ *        says so, with an upper bound on the maxflow for
+ *        deciding whether a target could still be met
+ *
+ * @param on The graph to operate on
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param options When to stop early
+ * @param verbose Whether to log each iteration to `cout`
+ *
+ * @return The flow found, an upper bound, and why it stopped
+ */
+flow_result ford_fulkerson(graph &on, const int &s, const int &t, const solver_options &options,
+                           const bool &verbose = true);
 
 /**
  * @brief Returns the maxflow of a given graph the Edmonds Karp
@@ -182,9 +384,48 @@ int ford_fulkerson(graph &on, const int &s, const int &t, int &iterations);
  * @param s The index of the starting node
  * @param t The index of the ending node
  * @param iterations Replaced by the number of iterations
+ * @param verbose Whether to log each iteration to `cout`
  *
  * @return The max flow across the graph from `s` to `t`
  */
-int edmonds_karp(graph &on, const int &s, const int &t, int &iterations);
+int edmonds_karp(graph &on, const int &s, const int &t, int &iterations, const bool &verbose = true);
+
+/**
+ * @brief Like `edmonds_karp`, but stops early when `options`
+ *        says so, with an upper bound on the maxflow for
+ *        deciding whether a target could still be met
+ *
+ * @param on The graph to operate on
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param options When to stop early
+ * @param verbose Whether to log each iteration to `cout`
+ *
+ * @return The flow found, an upper bound, and why it stopped
+ */
+flow_result edmonds_karp(graph &on, const int &s, const int &t, const solver_options &options,
+                         const bool &verbose = true);
+
+/**
+ * @brief Returns the maxflow from a set of sources to a set of
+ *        sinks using Edmonds-Karp with a multi-source BFS. The
+ *        terminals are handled in the search itself, so no
+ *        super-source or super-sink is added to the graph.
+ *
+ * @param on The graph to operate on
+ * @param sources The source nodes and their supply limits
+ * @param sinks The sink nodes and their demand limits; must not
+ *        share any node with `sources`
+ * @param iterations Replaced by the number of iterations
+ * @param verbose Whether to log each iteration to `cout`
+ *
+ * @return The max flow across the graph from `sources` to
+ *         `sinks`, saturating at `INT_MAX`
+ *
+ * @throw std::runtime_error if a terminal is not a node of the
+ *        graph, or a node is both a source and a sink
+ */
+int multi_terminal_maxflow(graph &on, const std::vector<terminal> &sources, const std::vector<terminal> &sinks,
+                           int &iterations, const bool &verbose = true);
 
 #endif
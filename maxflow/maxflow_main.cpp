@@ -6,24 +6,162 @@ jdehmel@outlook.com
 jedehmel@mavs.coloradomesa.edu
 */
 
+#include "components.hpp"
+#include "kernels.hpp"
+#include "matching.hpp"
 #include "maxflow.hpp"
+#include "widest_path.hpp"
 #include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 using namespace std;
 
+// Parses a comma-separated list of terminals, each either `node`
+// or `node:limit`. Returns false on malformed input.
+static bool parse_terminals(const string &text, vector<terminal> &out)
+{
+    stringstream strm(text);
+    string item;
+
+    out.clear();
+    while (getline(strm, item, ','))
+    {
+        terminal cur;
+        size_t colon = item.find(':');
+
+        try
+        {
+            cur.node = stoi(item.substr(0, colon));
+            if (colon != string::npos)
+            {
+                cur.limit = stoi(item.substr(colon + 1));
+            }
+        }
+        catch (const exception &e)
+        {
+            return false;
+        }
+
+        if (cur.limit < 0)
+        {
+            return false;
+        }
+
+        out.push_back(cur);
+    }
+
+    return !out.empty();
+}
+
+// Names a stop_reason for output
+static const char *describe(const stop_reason &reason)
+{
+    switch (reason)
+    {
+    case stop_reason::target_reached:
+        return "target reached";
+    case stop_reason::iteration_budget:
+        return "out of passes";
+    case stop_reason::time_budget:
+        return "out of time";
+    default:
+        return "completed";
+    }
+}
+
+// Solves a multi-source, multi-sink problem both directly and
+// split by component, and compares the two
+static int run_multi_terminal(graph &g, const graph_components &components, const vector<terminal> &sources,
+                              const vector<terminal> &sinks)
+{
+    unsigned long long MT_elapsed_ns = 0, CC_elapsed_ns = 0;
+    int MT_result, CC_result, MT_iterations, CC_subproblems;
+    thread_pool pool;
+
+    // Perform multi-terminal EK and time
+    {
+        auto start = chrono::high_resolution_clock::now();
+        MT_result = multi_terminal_maxflow(g, sources, sinks, MT_iterations);
+        auto end = chrono::high_resolution_clock::now();
+        MT_elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    }
+
+    // Perform the per-component version and time
+    {
+        auto start = chrono::high_resolution_clock::now();
+        CC_result = component_maxflow(g, components, sources, sinks, pool, &CC_subproblems);
+        auto end = chrono::high_resolution_clock::now();
+        CC_elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    }
+
+    // Output results
+    cout << "MT result: " << MT_result << '\n'
+         << "MT ns:     " << MT_elapsed_ns << '\n'
+         << "MT ms:     " << (MT_elapsed_ns) / (double)(1'000'000) << '\n'
+         << "MT passes: " << MT_iterations << "\n\n"
+         << "CC result: " << CC_result << '\n'
+         << "CC ns:     " << CC_elapsed_ns << '\n'
+         << "CC ms:     " << (CC_elapsed_ns) / (double)(1'000'000) << '\n'
+         << "CC pieces: " << CC_subproblems << " on " << pool.size() << " threads\n\n";
+
+    // Error checking for result match
+    if (MT_result != CC_result)
+    {
+        cerr << "Error: MT result does not match CC result!\n\n";
+
+        return 4;
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     string filepath;
     ifstream file;
     graph g;
+    graph_components components;
+    vector<terminal> sources, sinks;
+    string terminals;
     int s, t;
     // chrono::_V2::system_clock::time_point start, end;
-    unsigned long long FF_elapsed_ns = 0, EK_elapsed_ns = 0;
-    int FF_result, EK_result, FF_iterations, EK_iterations;
+    unsigned long long FF_elapsed_ns = 0, EK_elapsed_ns = 0, WP_elapsed_ns = 0;
+    int FF_result, EK_result, WP_result, FF_iterations, EK_iterations, WP_iterations;
+    flow_result FF_run, EK_run;
+    solver_options limits;
+    bool limited = false;
     double percentage_faster;
 
+    // Pick the vectorized kernels; MAXFLOW_KERNELS can force
+    // "scalar", "sse4.1" or "avx2" instead of the widest one
+    if (getenv("MAXFLOW_KERNELS") != nullptr && !select_kernels(string(getenv("MAXFLOW_KERNELS"))))
+    {
+        cerr << "Error: Unsupported MAXFLOW_KERNELS '" << getenv("MAXFLOW_KERNELS") << "'\n";
+
+        return 5;
+    }
+
+    // MAXFLOW_TARGET, MAXFLOW_MAX_PASSES and MAXFLOW_BUDGET_MS let
+    // FF and EK stop early, reporting a bound on the maxflow
+    if (getenv("MAXFLOW_TARGET") != nullptr)
+    {
+        limits.target_flow = atoi(getenv("MAXFLOW_TARGET"));
+        limited = true;
+    }
+    if (getenv("MAXFLOW_MAX_PASSES") != nullptr)
+    {
+        limits.max_iterations = atoi(getenv("MAXFLOW_MAX_PASSES"));
+        limited = true;
+    }
+    if (getenv("MAXFLOW_BUDGET_MS") != nullptr)
+    {
+        limits.time_budget = chrono::milliseconds(atoll(getenv("MAXFLOW_BUDGET_MS")));
+        limited = true;
+    }
+
     // Get file to load from
     if (argc >= 2)
     {
@@ -48,50 +186,127 @@ int main(int argc, char *argv[])
     }
 
     // Load graph
-    g = load_graph(file);
+    g = load_graph(file, components);
 
     // Close input file
     file.close();
 
     // Display info
-    cout << "'" << filepath << "' contains " << g.nodes.size() << " nodes.\n";
+    cout << "'" << filepath << "' contains " << g.nodes.size() << " nodes in " << components.count
+         << " weakly connected components.\n"
+         << "Using " << kernels().name << " kernels.\n";
 
-    // Get s and t
+    // Get s and t. Either may be a comma-separated list of
+    // `node` or `node:limit` for a multi-terminal problem.
     if (argc >= 3)
     {
-        s = atoi(argv[2]);
+        terminals = argv[2];
     }
     else
     {
         cout << "Source (s) node index: ";
-        cin >> s;
+        cin >> terminals;
     }
 
-    if (s < 0 || s >= g.nodes.size())
+    if (!parse_terminals(terminals, sources))
     {
-        cerr << "Error: Invalid source node " << s << "\n";
+        cerr << "Error: Invalid source list '" << terminals << "'\n";
 
         return 2;
     }
 
+    for (const auto &source : sources)
+    {
+        if (source.node < 0 || (size_t)source.node >= g.nodes.size())
+        {
+            cerr << "Error: Invalid source node " << source.node << "\n";
+
+            return 2;
+        }
+    }
+
     if (argc >= 4)
     {
-        t = atoi(argv[3]);
+        terminals = argv[3];
     }
     else
     {
         cout << "Sink (t) node index:   ";
-        cin >> t;
+        cin >> terminals;
     }
 
+    if (!parse_terminals(terminals, sinks))
+    {
+        cerr << "Error: Invalid sink list '" << terminals << "'\n";
+
+        return 3;
+    }
+
+    for (const auto &sink : sinks)
+    {
+        for (const auto &source : sources)
+        {
+            if (sink.node == source.node)
+            {
+                cerr << "Error: Node " << sink.node << " is both a source and a sink\n";
+
+                return 3;
+            }
+        }
+
+        if (sink.node < 0 || (size_t)sink.node >= g.nodes.size())
+        {
+            cerr << "Error: Invalid sink node " << sink.node << "\n";
+
+            return 3;
+        }
+    }
+
+    // Several terminals or any limits: solve natively instead of
+    // comparing FF and EK
+    if (sources.size() > 1 || sinks.size() > 1 || sources[0].limit != INT_MAX || sinks[0].limit != INT_MAX)
+    {
+        cout << "\ns=";
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            cout << (i == 0 ? "" : ",") << sources[i].node;
+        }
+        cout << "\nt=";
+        for (size_t i = 0; i < sinks.size(); i++)
+        {
+            cout << (i == 0 ? "" : ",") << sinks[i].node;
+        }
+        cout << "\n\n" << flush;
+
+        return run_multi_terminal(g, components, sources, sinks);
+    }
+
+    s = sources[0].node;
+    t = sinks[0].node;
+
     cout << "\ns=" << s << "\n"
          << "t=" << t << "\n";
 
-    if (t < 0 || t >= g.nodes.size() || t == s)
+    // Flow never leaves the weakly connected component holding s:
+    // with t elsewhere there is none, and otherwise only that
+    // component needs solving
+    if (components.label[s] != components.label[t])
     {
-        cerr << "Error: Invalid sink node " << t << "\n";
+        cout << "s and t are in different components, so no flow can reach t.\n\n"
+             << "Maxflow: 0\n";
 
-        return 3;
+        return 0;
+    }
+
+    if (components.count > 1)
+    {
+        int c = components.label[s];
+        g = extract_component(g, components, c);
+        s = components.local[s];
+        t = components.local[t];
+
+        cout << "Solving only the " << components.size(c) << " nodes of their component (as s=" << s << ", t=" << t
+             << ").\n";
     }
 
     cout << '\n' << flush;
@@ -99,17 +314,29 @@ int main(int argc, char *argv[])
     // Perform FF and time
     {
         auto start = chrono::high_resolution_clock::now();
-        FF_result = ford_fulkerson(g, s, t, FF_iterations);
+        FF_run = ford_fulkerson(g, s, t, limits);
         auto end = chrono::high_resolution_clock::now();
         FF_elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+        FF_result = FF_run.flow;
+        FF_iterations = FF_run.iterations;
     }
 
     // Perform EK and time
     {
         auto start = chrono::high_resolution_clock::now();
-        EK_result = edmonds_karp(g, s, t, EK_iterations);
+        EK_run = edmonds_karp(g, s, t, limits);
         auto end = chrono::high_resolution_clock::now();
         EK_elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+        EK_result = EK_run.flow;
+        EK_iterations = EK_run.iterations;
+    }
+
+    // Perform widest-path augmentation and time
+    {
+        auto start = chrono::high_resolution_clock::now();
+        WP_result = widest_path_maxflow(g, s, t, WP_iterations);
+        auto end = chrono::high_resolution_clock::now();
+        WP_elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
     }
 
     // Output results
@@ -117,25 +344,90 @@ int main(int argc, char *argv[])
          << "FF ns:     " << FF_elapsed_ns << '\n'
          << "FF ms:     " << (FF_elapsed_ns) / (double)(1'000'000) << '\n'
          << "FF passes: " << FF_iterations << '\n'
-         << "FF f*/p:   " << FF_result / (double)(FF_iterations) << "\n\n"
+         << "FF f*/p:   " << FF_result / (double)(FF_iterations) << '\n';
+    if (limited)
+    {
+        cout << "FF bound:  " << FF_run.upper_bound << '\n'
+             << "FF stop:   " << describe(FF_run.reason) << '\n';
+    }
+
+    cout << '\n'
          << "EK result: " << EK_result << '\n'
          << "EK ns:     " << EK_elapsed_ns << '\n'
          << "EK ms:     " << (EK_elapsed_ns) / (double)(1'000'000) << '\n'
          << "EK passes: " << EK_iterations << '\n'
-         << "EK f*/p:   " << EK_result / (double)(EK_iterations) << "\n\n";
+         << "EK f*/p:   " << EK_result / (double)(EK_iterations) << '\n';
+    if (limited)
+    {
+        cout << "EK bound:  " << EK_run.upper_bound << '\n'
+             << "EK stop:   " << describe(EK_run.reason) << '\n';
+    }
+
+    cout << '\n'
+         << "WP result: " << WP_result << '\n'
+         << "WP ns:     " << WP_elapsed_ns << '\n'
+         << "WP ms:     " << (WP_elapsed_ns) / (double)(1'000'000) << '\n'
+         << "WP passes: " << WP_iterations << '\n'
+         << "WP f*/p:   " << WP_result / (double)(WP_iterations) << "\n\n";
 
     // Show speed comparison
     percentage_faster = (((FF_elapsed_ns) / (double)(EK_elapsed_ns)) - 1.0) * 100.0;
     cout << "EK is " << percentage_faster << "% faster than FF.\n\n";
+    cout << "WP is " << (((EK_elapsed_ns) / (double)(WP_elapsed_ns)) - 1.0) * 100.0 << "% faster than EK, with "
+         << EK_iterations / (double)(WP_iterations) << "x fewer passes.\n\n";
 
-    // Error checking for result match
-    if (FF_result != EK_result)
+    // Unit-capacity bipartite problems also go through Hopcroft-Karp
+    bipartite_instance instance;
+    if (detect_bipartite_matching(g, s, t, instance))
+    {
+        unsigned long long HK_elapsed_ns = 0;
+        int HK_result, HK_phases;
+        vector<pair<int, int>> matching;
+
+        auto start = chrono::high_resolution_clock::now();
+        HK_result = hopcroft_karp(instance, matching, HK_phases);
+        auto end = chrono::high_resolution_clock::now();
+        HK_elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+
+        cout << "Detected a unit-capacity bipartite matching.\n"
+             << "HK result: " << HK_result << '\n'
+             << "HK ns:     " << HK_elapsed_ns << '\n'
+             << "HK ms:     " << (HK_elapsed_ns) / (double)(1'000'000) << '\n'
+             << "HK phases: " << HK_phases << "\n\n";
+
+        if (EK_run.reason == stop_reason::completed && HK_result != EK_result)
+        {
+            cerr << "Error: HK result does not match EK result!\n\n";
+
+            return 4;
+        }
+    }
+
+    // Error checking for result match. A run which stopped early
+    // must only stay within its bounds.
+    if (FF_run.reason == stop_reason::completed && EK_run.reason == stop_reason::completed &&
+        FF_result != EK_result)
     {
         cerr << "Error: FF result does not match EK result!\n\n";
 
         return 4;
     }
 
+    if (EK_run.reason == stop_reason::completed && WP_result != EK_result)
+    {
+        cerr << "Error: WP result does not match EK result!\n\n";
+
+        return 4;
+    }
+
+    if (WP_result < FF_result || WP_result > FF_run.upper_bound || WP_result < EK_result ||
+        WP_result > EK_run.upper_bound)
+    {
+        cerr << "Error: A bound does not hold!\n\n";
+
+        return 4;
+    }
+
     // Exit
     return 0;
 }
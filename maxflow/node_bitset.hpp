@@ -0,0 +1,84 @@
+/**
+ * @file node_bitset.hpp
+ *
+ * @brief A dense bitset indexed by node, used for the visited
+ *        and frontier sets of the augmenting path searches.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef NODE_BITSET_HPP
+#define NODE_BITSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct node_bitset
+ * @brief One bit per node, packed 64 nodes to a word. Bits past
+ *        `bits` in the last word are always zero.
+ *
+ * @var node_bitset::words
+ * The packed bits. Node `i` is bit `i % 64` of `words[i / 64]`.
+ *
+ * @var node_bitset::bits
+ * The number of nodes covered
+ */
+struct node_bitset
+{
+    std::vector<uint64_t> words;
+    size_t bits = 0;
+
+    node_bitset() = default;
+
+    explicit node_bitset(const size_t &n)
+    {
+        resize(n);
+    }
+
+    // Resizes to n nodes, all clear
+    void resize(const size_t &n)
+    {
+        bits = n;
+        words.assign((n + 63) / 64, 0);
+    }
+
+    // Clears every bit without reallocating
+    void clear()
+    {
+        for (auto &word : words)
+        {
+            word = 0;
+        }
+    }
+
+    bool test(const int &i) const
+    {
+        return (words[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void set(const int &i)
+    {
+        words[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+
+    void reset(const int &i)
+    {
+        words[i >> 6] &= ~((uint64_t)1 << (i & 63));
+    }
+
+    // The valid bits of word w, for scanning complements
+    uint64_t mask(const size_t &w) const
+    {
+        if (w + 1 < words.size() || bits % 64 == 0)
+        {
+            return ~(uint64_t)0;
+        }
+        return ((uint64_t)1 << (bits % 64)) - 1;
+    }
+};
+
+#endif
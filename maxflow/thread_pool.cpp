@@ -0,0 +1,58 @@
+#include "thread_pool.hpp"
+
+thread_pool::thread_pool(unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; i++)
+    {
+        workers.emplace_back([this]() { work(); });
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Worker loop: runs tasks until stopping and the queue is empty
+void thread_pool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            if (tasks.empty())
+            {
+                // Stopping and nothing left to do
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+    }
+}
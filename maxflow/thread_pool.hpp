@@ -0,0 +1,90 @@
+/**
+ * @file thread_pool.hpp
+ *
+ * @brief A fixed-size pool of worker threads for solving
+ *        independent flow subproblems concurrently.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @class thread_pool
+ * @brief Runs submitted tasks on a fixed set of worker threads,
+ *        in submission order. The destructor finishes every
+ *        queued task before joining the workers.
+ */
+class thread_pool
+{
+  public:
+    /**
+     * @brief Starts the workers
+     *
+     * @param threads The number of workers. Zero means one per
+     *        hardware thread.
+     */
+    explicit thread_pool(unsigned threads = 0);
+
+    ~thread_pool();
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    /**
+     * @brief Queues a task
+     *
+     * @param task The callable to run on a worker
+     *
+     * @return A future for the task's result. Exceptions thrown
+     *         by the task are rethrown by `get()`.
+     */
+    template <typename F> auto submit(F task) -> std::future<decltype(task())>
+    {
+        using result_type = decltype(task());
+
+        auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::move(task));
+        std::future<result_type> out = packaged->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            tasks.push([packaged]() { (*packaged)(); });
+        }
+        wake.notify_one();
+
+        return out;
+    }
+
+    /**
+     * @brief Returns the number of worker threads
+     *
+     * @return The number of workers
+     */
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+  private:
+    void work();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "widest_path.hpp"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+void widest_workspace::prepare(const graph &on)
+{
+    size_t n = on.nodes.size();
+
+    if (done.bits != n)
+    {
+        done.resize(n);
+        handle.resize(n);
+        parent.resize(n);
+        forwards.resize(n);
+    }
+    else
+    {
+        done.clear();
+    }
+
+    queue.clear();
+    width.assign(n, 0);
+}
+
+// Offers node `to` a path through `from` with bottleneck `w`,
+// keeping it only if it is wider than the best one so far
+static void relax(widest_workspace &ws, const int &from, const int &to, const int &w, const bool &forwards)
+{
+    if (w <= ws.width[to] || ws.done.test(to))
+    {
+        return;
+    }
+
+    // Already queued with a narrower path: move its entry
+    if (ws.width[to] > 0)
+    {
+        ws.queue.erase(ws.handle[to]);
+    }
+
+    ws.width[to] = w;
+    ws.parent[to] = from;
+    ws.forwards[to] = forwards;
+    ws.handle[to] = ws.queue.try_emplace(make_pair(w, to)).first;
+}
+
+// Dijkstra's algorithm with "distance" the bottleneck so far,
+// which only shrinks along a path, so the widest queued node is
+// always final
+vector<edge> get_path_widest(const graph &residual, const graph &capacities, const int &s, const int &t,
+                             widest_workspace &workspace, int &bottleneck)
+{
+    widest_workspace &ws = workspace;
+    ws.prepare(residual);
+    bottleneck = 0;
+
+    if (s == t)
+    {
+        return vector<edge>{};
+    }
+
+    ws.width[s] = INT_MAX;
+    ws.parent[s] = -1;
+    ws.handle[s] = ws.queue.try_emplace(make_pair(INT_MAX, s)).first;
+
+    while (!ws.queue.empty())
+    {
+        auto widest = ws.queue.begin();
+        int cur = widest->first.second, w = widest->first.first;
+        ws.queue.erase(widest);
+        ws.done.set(cur);
+
+        if (cur == t)
+        {
+            break;
+        }
+
+        // Forwards edges with remaining capacity
+        for (const auto &p : residual.nodes[cur].edges)
+        {
+            if (p.second > 0)
+            {
+                relax(ws, cur, p.first, min(w, p.second), true);
+            }
+        }
+
+        // Backwards edges with flow to cancel
+        for (const auto &from : residual.nodes[cur].nodes_having_backwards_edges)
+        {
+            int flow = capacities.nodes[from].edges.at(cur) - residual.nodes[from].edges.at(cur);
+            if (flow > 0)
+            {
+                relax(ws, cur, from, min(w, flow), false);
+            }
+        }
+    }
+
+    if (!ws.done.test(t))
+    {
+        return vector<edge>{};
+    }
+
+    // Same encoding as the other searches: forwards edges carry
+    // their residual weight, backwards edges a zero
+    vector<edge> out;
+    for (int position = t; ws.parent[position] != -1; position = ws.parent[position])
+    {
+        int from = ws.parent[position];
+        out.push_back(edge{position, ws.forwards[position] ? residual.nodes[from].edges.at(position) : 0});
+    }
+    reverse(out.begin(), out.end());
+
+    bottleneck = ws.width[t];
+    return out;
+}
+
+// Returns the maxflow of a given graph by augmenting along the
+// widest path each time
+int widest_path_maxflow(graph &capacities, const int &s, const int &t, int &iterations, const bool &verbose)
+{
+    graph residual = capacities;
+    widest_workspace workspace;
+    int out = 0, bottleneck;
+
+    iterations = 0;
+
+    while (true)
+    {
+        vector<edge> path = get_path_widest(residual, capacities, s, t, workspace, bottleneck);
+
+        if (path.size() == 0)
+        {
+            break;
+        }
+
+        subtract_augmenting_path(path, residual, s, bottleneck);
+        out += bottleneck;
+        iterations++;
+
+        if (verbose)
+        {
+            cout << "WP is on iteration " << iterations << "\t w/ flow " << out << '\n';
+        }
+    }
+
+    return out;
+}
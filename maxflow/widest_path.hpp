@@ -0,0 +1,110 @@
+/**
+ * @file widest_path.hpp
+ *
+ * @brief Maximum-bottleneck ("fattest path") augmentation for
+ *        maxflow problems.
+ *
+ * Instead of the first path (Ford-Fulkerson) or the shortest
+ * one (Edmonds-Karp), each iteration augments along the path
+ * whose smallest residual capacity is largest. That path is found
+ * with a Dijkstra-style search, and it takes at most
+ * O(e log f) augmentations, where f is the max flow; with widely
+ * varying capacities that is far fewer than Edmonds-Karp needs.
+ *
+ * The search's priority queue is the pooled RBTree from
+ * ../red-black-tree, keyed by (bottleneck, node), with a handle
+ * to each node's entry so that a wider path to a queued node
+ * moves its entry instead of adding a second one.
+ *
+ * Jordan Dehmel, 2023
+ * jdehmel@outlook.com
+ * jedehmel@mavs.coloradomesa.edu
+ */
+
+#ifndef WIDEST_PATH_HPP
+#define WIDEST_PATH_HPP
+
+#include "maxflow.hpp"
+#include "rbtree.hpp"
+#include <functional>
+#include <utility>
+
+/**
+ * @brief Ordered set of (bottleneck, node) entries, widest
+ *        first
+ */
+typedef RBTree<std::pair<int, int>, RBNoValue, std::greater<std::pair<int, int>>> widest_queue;
+
+/**
+ * @struct widest_workspace
+ * @brief Scratch space for `get_path_widest`. A solver keeps one
+ *        for its whole run so that each search only resets it
+ *        instead of allocating per node.
+ *
+ * @var widest_workspace::queue
+ * The nodes reached but not yet finished, widest first
+ * @var widest_workspace::handle
+ * handle[i] is node i's entry in `queue`; only meaningful while
+ * width[i] > 0 and i is not done
+ * @var widest_workspace::width
+ * The widest bottleneck found so far from the source to each
+ * node, or 0 if none
+ * @var widest_workspace::parent
+ * parent[i] is the node the widest path to i came from
+ * @var widest_workspace::forwards
+ * Whether that step crossed a forwards edge (rather than
+ * cancelling flow on a backwards one)
+ * @var widest_workspace::done
+ * The nodes whose widest path is final
+ */
+struct widest_workspace
+{
+    widest_queue queue;
+    std::vector<widest_queue::iterator> handle;
+    std::vector<int> width, parent;
+    std::vector<char> forwards;
+    node_bitset done;
+
+    /**
+     * @brief Readies the workspace for a search on `on`
+     *
+     * @param on The graph about to be searched
+     */
+    void prepare(const graph &on);
+};
+
+/**
+ * @brief Returns the augmenting path from the source to the sink
+ *        whose bottleneck (smallest residual capacity) is
+ *        largest, using Dijkstra's algorithm on bottlenecks.
+ *        Takes O(e log n) time.
+ *
+ * @param residual The residual (remaining unused flow) graph
+ * @param capacities The capacity graph
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param workspace Scratch space, resized as needed
+ * @param bottleneck Replaced by the path's bottleneck, or 0 if
+ *        there is no path
+ *
+ * @return A vector of edges representing the widest augmenting
+ *         path, empty if `t` cannot be reached
+ */
+std::vector<edge> get_path_widest(const graph &residual, const graph &capacities, const int &s, const int &t,
+                                  widest_workspace &workspace, int &bottleneck);
+
+/**
+ * @brief Returns the maxflow of a given graph by always
+ *        augmenting along the widest path
+ *
+ * @param on The graph to operate on
+ * @param s The index of the starting node
+ * @param t The index of the ending node
+ * @param iterations Replaced by the number of iterations
+ * @param verbose Whether to log each iteration to `cout`
+ *
+ * @return The max flow across the graph from `s` to `t`
+ */
+int widest_path_maxflow(graph &on, const int &s, const int &t, int &iterations, const bool &verbose = true);
+
+#endif
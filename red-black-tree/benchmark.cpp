@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bplus_tree.hpp"
+#include "counting_rbtree.hpp"
+#include "rbtree.hpp"
+
+using namespace std;
+
+// Benchmark driver for the ordered indexes. Every structure and key
+// distribution is run in its own child process, so peak RSS belongs
+// to that run alone, and each phase prints one CSV line:
+//
+//   structure,distribution,phase,keys,ops,mean_ns,p50_ns,p90_ns,p99_ns,max_ns,bytes_per_key,peak_rss_kb
+//
+// Latencies are per operation, measured over batches of BATCH
+// operations since one clock read costs about as much as a lookup.
+// The percentiles are over all batches of all repetitions.
+//
+// Arguments are name=value pairs, all optional:
+//   size=N       keys inserted per run (default 1000000)
+//   reps=R       times each run is repeated (default 3)
+//   read=P       percent of lookups in the mixed phase (default 90)
+//   seed=S       random seed (default 1)
+//   dist=a,b     uniform, sorted, zipf, dups or all (default all)
+//   structure=a,b  rbtree, counting-rbtree, bplus-tree, std-multiset,
+//                std-map or all (default all)
+
+static const size_t BATCH = 64;
+
+// bytes currently held through CountingAllocator
+static size_t liveBytes = 0;
+
+// checksum of lookup results, so no lookup can be optimized away
+static size_t found = 0;
+
+template <typename T>
+struct CountingAllocator {
+	typedef T value_type;
+
+	CountingAllocator() = default;
+
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U> &) {}
+
+	T *allocate(size_t n) {
+		liveBytes += n * sizeof(T);
+		return allocator<T>().allocate(n);
+	}
+
+	void deallocate(T *p, size_t n) {
+		liveBytes -= n * sizeof(T);
+		allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const CountingAllocator<U> &) const {
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const CountingAllocator<U> &) const {
+		return false;
+	}
+};
+
+// Each index behind the same three operations. The multisets keep
+// every copy of a key; the others keep a count per distinct key.
+// erase removes one copy.
+struct RBTreeIndex {
+	RBTree<int, RBNoValue, less<int>, CountingAllocator<pair<const int, RBNoValue>>> tree;
+
+	void insert(int k) {
+		tree.insert(k);
+	}
+
+	bool find(int k) {
+		return tree.searchTree(k) != nullptr;
+	}
+
+	bool erase(int k) {
+		return tree.deleteNode(k);
+	}
+
+	size_t bytes() const {
+		return liveBytes;
+	}
+};
+
+struct CountingRBTreeIndex {
+	CountingRBTree<int, less<int>, unsigned, CountingAllocator<pair<const int, unsigned>>> tree;
+
+	void insert(int k) {
+		tree.insert(k);
+	}
+
+	bool find(int k) {
+		return tree.contains(k);
+	}
+
+	bool erase(int k) {
+		return tree.deleteNode(k);
+	}
+
+	size_t bytes() const {
+		return liveBytes;
+	}
+};
+
+struct BPlusTreeIndex {
+	BPlusTree tree;
+
+	void insert(int k) {
+		tree.insert(k);
+	}
+
+	bool find(int k) {
+		return tree.contains(k);
+	}
+
+	bool erase(int k) {
+		return tree.deleteNode(k);
+	}
+
+	size_t bytes() const {
+		return tree.calculateMemoryUsage();
+	}
+};
+
+struct StdMultisetIndex {
+	multiset<int, less<int>, CountingAllocator<int>> tree;
+
+	void insert(int k) {
+		tree.insert(k);
+	}
+
+	bool find(int k) {
+		return tree.find(k) != tree.end();
+	}
+
+	bool erase(int k) {
+		auto it = tree.find(k);
+		if (it == tree.end()) {
+			return false;
+		}
+		tree.erase(it);
+		return true;
+	}
+
+	size_t bytes() const {
+		return liveBytes;
+	}
+};
+
+struct StdMapIndex {
+	map<int, unsigned, less<int>, CountingAllocator<pair<const int, unsigned>>> tree;
+
+	void insert(int k) {
+		tree[k]++;
+	}
+
+	bool find(int k) {
+		return tree.find(k) != tree.end();
+	}
+
+	bool erase(int k) {
+		auto it = tree.find(k);
+		if (it == tree.end()) {
+			return false;
+		}
+		if (--it->second == 0) {
+			tree.erase(it);
+		}
+		return true;
+	}
+
+	size_t bytes() const {
+		return liveBytes;
+	}
+};
+
+struct Options {
+	size_t size = 1000000;
+	int reps = 3;
+	int readPercent = 90;
+	unsigned long seed = 1;
+	vector<string> distributions = {"uniform", "sorted", "zipf", "dups"};
+	vector<string> structures = {"rbtree", "counting-rbtree", "bplus-tree", "std-multiset", "std-map"};
+};
+
+// Draws keys from one of the named distributions over [0, size)
+class KeySource {
+private:
+	string distribution;
+	size_t size;
+	mt19937_64 random;
+	vector<double> zipfCdf; // zipfCdf[r] = P(rank <= r)
+	size_t nextSorted = 0;
+
+public:
+	KeySource(const string &name, size_t n, unsigned long seed) : distribution(name), size(n), random(seed) {
+		if (distribution == "zipf") {
+			// s = 0.99, as in YCSB; rank r is key r, so hot keys are small
+			zipfCdf.resize(size);
+			double total = 0;
+			for (size_t r = 0; r < size; r++) {
+				total += 1.0 / pow(double(r + 1), 0.99);
+				zipfCdf[r] = total;
+			}
+			for (double &p : zipfCdf) {
+				p /= total;
+			}
+		}
+	}
+
+	static bool known(const string &name) {
+		return name == "uniform" || name == "sorted" || name == "zipf" || name == "dups";
+	}
+
+	// the next key to insert
+	int next() {
+		if (distribution == "sorted") {
+			return int(nextSorted++ % size);
+		}
+		return any();
+	}
+
+	// a key from the distribution, ignoring insertion order
+	int any() {
+		if (distribution == "zipf") {
+			double p = uniform_real_distribution<double>(0, 1)(random);
+			return int(lower_bound(zipfCdf.begin(), zipfCdf.end(), p) - zipfCdf.begin());
+		}
+		// a hundred copies of each key on average
+		size_t range = distribution == "dups" ? max<size_t>(1, size / 100) : size;
+		return int(random() % range);
+	}
+
+	mt19937_64 &engine() {
+		return random;
+	}
+};
+
+// per-operation latencies of one phase, in batches
+struct Samples {
+	vector<double> perOp; // nanoseconds per operation in each batch
+	double totalNs = 0;
+	size_t ops = 0;
+
+	template <typename Op>
+	void time(size_t count, Op op) {
+		for (size_t i = 0; i < count;) {
+			size_t end = min(count, i + BATCH), batch = end - i;
+			auto start = chrono::steady_clock::now();
+			for (; i < end; i++) {
+				op(i);
+			}
+			double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+			perOp.push_back(ns / batch);
+			totalNs += ns;
+		}
+		ops += count;
+	}
+
+	double percentile(double p) {
+		if (perOp.empty()) {
+			return 0;
+		}
+		size_t at = min(perOp.size() - 1, size_t(p / 100 * perOp.size()));
+		nth_element(perOp.begin(), perOp.begin() + at, perOp.end());
+		return perOp[at];
+	}
+};
+
+static long peakRssKb() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss; // kilobytes on Linux
+}
+
+template <typename Index>
+static void runIndex(const string &structure, const string &distribution, const Options &options) {
+	const char *phases[] = {"insert", "search", "mixed", "delete"};
+	Samples samples[4];
+	size_t bytes = 0;
+
+	for (int rep = 0; rep < options.reps; rep++) {
+		KeySource source(distribution, options.size, options.seed + rep);
+		vector<int> keys(options.size), lookups(options.size), mixed(options.size);
+		vector<int> mixedOps(options.size); // 0 lookup, 1 insert, 2 delete
+		for (size_t i = 0; i < options.size; i++) {
+			keys[i] = source.next();
+		}
+		for (size_t i = 0; i < options.size; i++) {
+			lookups[i] = source.any();
+			mixed[i] = source.any();
+			int roll = int(source.engine()() % 100);
+			mixedOps[i] = roll < options.readPercent ? 0 : 1 + roll % 2;
+		}
+		vector<int> deletes(keys);
+		shuffle(deletes.begin(), deletes.end(), source.engine());
+
+		unique_ptr<Index> index(new Index());
+		samples[0].time(keys.size(), [&](size_t i) { index->insert(keys[i]); });
+		bytes = index->bytes();
+		samples[1].time(lookups.size(), [&](size_t i) { found += index->find(lookups[i]); });
+		samples[2].time(mixed.size(), [&](size_t i) {
+			if (mixedOps[i] == 0) {
+				found += index->find(mixed[i]);
+			} else if (mixedOps[i] == 1) {
+				index->insert(mixed[i]);
+			} else {
+				found += index->erase(mixed[i]);
+			}
+		});
+		samples[3].time(deletes.size(), [&](size_t i) { found += index->erase(deletes[i]); });
+	}
+
+	for (int p = 0; p < 4; p++) {
+		cout << structure << "," << distribution << "," << phases[p] << "," << options.size << ","
+		     << samples[p].ops << "," << samples[p].totalNs / max<size_t>(1, samples[p].ops) << ","
+		     << samples[p].percentile(50) << "," << samples[p].percentile(90) << ","
+		     << samples[p].percentile(99) << "," << samples[p].percentile(100) << ","
+		     << double(bytes) / options.size << "," << peakRssKb() << "\n";
+	}
+	cout.flush();
+}
+
+static bool runStructure(const string &structure, const string &distribution, const Options &options) {
+	if (structure == "rbtree") {
+		runIndex<RBTreeIndex>(structure, distribution, options);
+	} else if (structure == "counting-rbtree") {
+		runIndex<CountingRBTreeIndex>(structure, distribution, options);
+	} else if (structure == "bplus-tree") {
+		runIndex<BPlusTreeIndex>(structure, distribution, options);
+	} else if (structure == "std-multiset") {
+		runIndex<StdMultisetIndex>(structure, distribution, options);
+	} else if (structure == "std-map") {
+		runIndex<StdMapIndex>(structure, distribution, options);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static vector<string> splitList(const string &text, const vector<string> &all) {
+	if (text == "all") {
+		return all;
+	}
+	vector<string> out;
+	stringstream strm(text);
+	string item;
+	while (getline(strm, item, ',')) {
+		out.push_back(item);
+	}
+	return out;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options) {
+	Options defaults;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		if (eq == string::npos) {
+			return false;
+		}
+		string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+		try {
+			if (name == "size") {
+				options.size = stoul(value);
+			} else if (name == "reps") {
+				options.reps = stoi(value);
+			} else if (name == "read") {
+				options.readPercent = stoi(value);
+			} else if (name == "seed") {
+				options.seed = stoul(value);
+			} else if (name == "dist") {
+				options.distributions = splitList(value, defaults.distributions);
+			} else if (name == "structure") {
+				options.structures = splitList(value, defaults.structures);
+			} else {
+				return false;
+			}
+		} catch (const exception &e) {
+			return false;
+		}
+	}
+	for (const string &distribution : options.distributions) {
+		if (!KeySource::known(distribution)) {
+			return false;
+		}
+	}
+	return options.size > 0 && options.reps > 0 && options.readPercent >= 0 && options.readPercent <= 100;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		cerr << "usage: " << argv[0]
+		     << " [size=N] [reps=R] [read=PERCENT] [seed=S] [dist=uniform,sorted,zipf,dups|all]"
+		        " [structure=rbtree,counting-rbtree,bplus-tree,std-multiset,std-map|all]"
+		     << endl;
+		return 1;
+	}
+
+	cout << "structure,distribution,phase,keys,ops,mean_ns,p50_ns,p90_ns,p99_ns,max_ns,bytes_per_key,peak_rss_kb"
+	     << endl;
+	int failures = 0;
+	for (const string &distribution : options.distributions) {
+		for (const string &structure : options.structures) {
+			// a fresh process per run keeps peak RSS per run
+			pid_t child = fork();
+			if (child == 0) {
+				bool known = runStructure(structure, distribution, options);
+				_exit(known && found != size_t(-1) ? 0 : 2);
+			}
+			int status = 0;
+			if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				cerr << structure << " on " << distribution << " failed" << endl;
+				failures++;
+			}
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
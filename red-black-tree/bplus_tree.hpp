@@ -0,0 +1,416 @@
+#ifndef BPLUS_TREE_HPP
+#define BPLUS_TREE_HPP
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include "node_pool.hpp"
+
+// Node header shared by B+-tree leaves and inner nodes. A node's
+// keys sit side by side, so searching one costs a few adjacent
+// cache lines rather than a pointer chase per comparison.
+struct BPlusNode {
+	static const int MAX_KEYS = 32;
+	int count; // keys in use
+	bool leaf;
+	int keys[MAX_KEYS]; // sorted, no duplicates; INT_MAX from count on
+};
+
+// copies[i] is how many times keys[i] has been inserted
+struct BPlusLeaf : BPlusNode {
+	unsigned copies[MAX_KEYS];
+};
+
+// children[i] holds the keys k with keys[i - 1] <= k < keys[i]
+struct BPlusInner : BPlusNode {
+	BPlusNode *children[MAX_KEYS + 1];
+};
+
+// B+-tree of ints with the same insert, search and delete interface
+// as the red-black trees. Every key lives in a leaf; inner nodes
+// only hold separators. With up to 32 keys a node, a million keys
+// are four or five levels deep instead of twenty, so a lookup
+// takes a handful of cache misses where RBTree takes one per level.
+// Within a node the position is found by counting the keys below
+// the target over the whole array, with no early exit: unused slots
+// hold INT_MAX, so every node takes the same MAX_KEYS compares and
+// the compiler turns the loop into SIMD compares.
+//
+// Like RBTree::insert, inserting a key again keeps both copies;
+// they share one slot and a count. Every node but the root stays at
+// least half full, so deletes merge or borrow from siblings.
+class BPlusTree {
+private:
+	static const int MAX_KEYS = BPlusNode::MAX_KEYS;
+	static const int MIN_KEYS = MAX_KEYS / 2;
+	// every inner node but the root has at least 17 children, so
+	// this is more levels than any tree in memory can have
+	static const int MAX_DEPTH = 16;
+
+	BPlusNode *root = nullptr;
+	NodePool<BPlusLeaf> leaves;
+	NodePool<BPlusInner> inners;
+	size_t total = 0; // keys, counting every copy
+	int depth = 0;    // inner levels above the leaves
+
+	// the root-to-leaf path of the current write; slot[i] is which
+	// child of path[i] the path continues into
+	BPlusInner *path[MAX_DEPTH];
+	int slot[MAX_DEPTH];
+
+	// keys in node less than k; the INT_MAX padding never is
+	static int countBelow(const BPlusNode *node, int k) {
+		int below = 0;
+		for (int i = 0; i < MAX_KEYS; i++) {
+			below += node->keys[i] < k;
+		}
+		return below;
+	}
+
+	// keys in node not greater than k, which is the child to take.
+	// The padding counts too when k is INT_MAX, hence the clamp.
+	static int countUpTo(const BPlusNode *node, int k) {
+		int below = 0;
+		for (int i = 0; i < MAX_KEYS; i++) {
+			below += node->keys[i] <= k;
+		}
+		return below < node->count ? below : node->count;
+	}
+
+	// shrinks node to its first count keys, padding the rest
+	static void truncate(BPlusNode *node, int count) {
+		std::fill(node->keys + count, node->keys + node->count, INT_MAX);
+		node->count = count;
+	}
+
+	// walks down to the leaf whose range holds k, filling in path
+	BPlusLeaf *findLeaf(int k) {
+		BPlusNode *node = root;
+		for (int i = 0; i < depth; i++) {
+			path[i] = static_cast<BPlusInner *>(node);
+			slot[i] = countUpTo(node, k);
+			node = path[i]->children[slot[i]];
+		}
+		return static_cast<BPlusLeaf *>(node);
+	}
+
+	BPlusLeaf *newLeaf() {
+		BPlusLeaf *leaf = leaves.allocate();
+		std::fill(leaf->keys, leaf->keys + MAX_KEYS, INT_MAX);
+		leaf->count = 0;
+		leaf->leaf = true;
+		return leaf;
+	}
+
+	BPlusInner *newInner() {
+		BPlusInner *inner = inners.allocate();
+		std::fill(inner->keys, inner->keys + MAX_KEYS, INT_MAX);
+		inner->count = 0;
+		inner->leaf = false;
+		return inner;
+	}
+
+	void freeNode(BPlusNode *node) {
+		if (node->leaf) {
+			leaves.deallocate(static_cast<BPlusLeaf *>(node));
+		} else {
+			inners.deallocate(static_cast<BPlusInner *>(node));
+		}
+	}
+
+	static void insertAt(BPlusLeaf *leaf, int pos, int k, unsigned copies) {
+		for (int i = leaf->count; i > pos; i--) {
+			leaf->keys[i] = leaf->keys[i - 1];
+			leaf->copies[i] = leaf->copies[i - 1];
+		}
+		leaf->keys[pos] = k;
+		leaf->copies[pos] = copies;
+		leaf->count++;
+	}
+
+	static void removeAt(BPlusLeaf *leaf, int pos) {
+		for (int i = pos; i < leaf->count - 1; i++) {
+			leaf->keys[i] = leaf->keys[i + 1];
+			leaf->copies[i] = leaf->copies[i + 1];
+		}
+		truncate(leaf, leaf->count - 1);
+	}
+
+	// Hangs child, whose keys are all >= separator, just right of
+	// the path at level i, splitting full nodes on the way up
+	void insertChild(int i, int separator, BPlusNode *child) {
+		for (; i >= 0; i--) {
+			BPlusInner *node = path[i];
+			int pos = slot[i]; // separator goes to keys[pos], child to children[pos + 1]
+
+			// lay out all MAX_KEYS + 1 keys in order, then share them out
+			int keys[MAX_KEYS + 1];
+			BPlusNode *children[MAX_KEYS + 2];
+			for (int j = 0, from = 0; j <= node->count; j++) {
+				keys[j] = j == pos ? separator : node->keys[from++];
+			}
+			for (int j = 0, from = 0; j <= node->count + 1; j++) {
+				children[j] = j == pos + 1 ? child : node->children[from++];
+			}
+			if (node->count < MAX_KEYS) {
+				node->count++;
+				for (int j = pos; j < node->count; j++) {
+					node->keys[j] = keys[j];
+					node->children[j + 1] = children[j + 1];
+				}
+				return;
+			}
+
+			// MIN_KEYS stay, the next key moves up, the rest go right
+			BPlusInner *right = newInner();
+			right->count = MAX_KEYS - MIN_KEYS;
+			for (int j = 0; j < right->count; j++) {
+				right->keys[j] = keys[MIN_KEYS + 1 + j];
+			}
+			for (int j = 0; j <= right->count; j++) {
+				right->children[j] = children[MIN_KEYS + 1 + j];
+			}
+			truncate(node, MIN_KEYS);
+			for (int j = 0; j < MIN_KEYS; j++) {
+				node->keys[j] = keys[j];
+				node->children[j + 1] = children[j + 1];
+			}
+			separator = keys[MIN_KEYS];
+			child = right;
+		}
+
+		// the root split, so the tree grows a level
+		BPlusInner *top = newInner();
+		top->count = 1;
+		top->keys[0] = separator;
+		top->children[0] = root;
+		top->children[1] = child;
+		root = top;
+		depth++;
+	}
+
+	// node, child slot[depth - 1] of the last node on the path, may
+	// have dropped below MIN_KEYS. Borrows a key from a sibling, or
+	// merges with it and carries on with the parent.
+	void rebalance(BPlusNode *node) {
+		for (int i = depth - 1; i >= 0 && node->count < MIN_KEYS; i--) {
+			BPlusInner *parent = path[i];
+			int l = slot[i] > 0 ? slot[i] - 1 : 0; // node and its sibling are children l and l + 1
+			BPlusNode *left = parent->children[l];
+			BPlusNode *right = parent->children[l + 1];
+			bool fromRight = node == left;
+
+			if (node->leaf) {
+				BPlusLeaf *a = static_cast<BPlusLeaf *>(left);
+				BPlusLeaf *b = static_cast<BPlusLeaf *>(right);
+				if (a->count + b->count <= MAX_KEYS) {
+					for (int j = 0; j < b->count; j++) {
+						insertAt(a, a->count, b->keys[j], b->copies[j]);
+					}
+					leaves.deallocate(b);
+				} else {
+					if (fromRight) {
+						insertAt(a, a->count, b->keys[0], b->copies[0]);
+						removeAt(b, 0);
+					} else {
+						insertAt(b, 0, a->keys[a->count - 1], a->copies[a->count - 1]);
+						removeAt(a, a->count - 1);
+					}
+					parent->keys[l] = b->keys[0];
+					return;
+				}
+			} else {
+				BPlusInner *a = static_cast<BPlusInner *>(left);
+				BPlusInner *b = static_cast<BPlusInner *>(right);
+				if (a->count + b->count < MAX_KEYS) {
+					// the separator comes down between the two halves
+					a->keys[a->count] = parent->keys[l];
+					for (int j = 0; j < b->count; j++) {
+						a->keys[a->count + 1 + j] = b->keys[j];
+					}
+					for (int j = 0; j <= b->count; j++) {
+						a->children[a->count + 1 + j] = b->children[j];
+					}
+					a->count += b->count + 1;
+					inners.deallocate(b);
+				} else {
+					// rotate one child through the parent
+					if (fromRight) {
+						a->keys[a->count] = parent->keys[l];
+						a->children[a->count + 1] = b->children[0];
+						a->count++;
+						parent->keys[l] = b->keys[0];
+						for (int j = 0; j < b->count - 1; j++) {
+							b->keys[j] = b->keys[j + 1];
+						}
+						for (int j = 0; j < b->count; j++) {
+							b->children[j] = b->children[j + 1];
+						}
+						truncate(b, b->count - 1);
+					} else {
+						for (int j = b->count; j > 0; j--) {
+							b->keys[j] = b->keys[j - 1];
+						}
+						for (int j = b->count + 1; j > 0; j--) {
+							b->children[j] = b->children[j - 1];
+						}
+						b->keys[0] = parent->keys[l];
+						b->children[0] = a->children[a->count];
+						b->count++;
+						parent->keys[l] = a->keys[a->count - 1];
+						truncate(a, a->count - 1);
+					}
+					return;
+				}
+			}
+
+			// right merged into left: drop its separator and link
+			for (int j = l; j < parent->count - 1; j++) {
+				parent->keys[j] = parent->keys[j + 1];
+				parent->children[j + 1] = parent->children[j + 2];
+			}
+			truncate(parent, parent->count - 1);
+			node = parent;
+		}
+
+		if (root->count == 0) {
+			BPlusNode *old = root;
+			root = root->leaf ? nullptr : static_cast<BPlusInner *>(root)->children[0];
+			freeNode(old);
+			if (depth > 0) {
+				depth--;
+			}
+		}
+	}
+
+	// copies under node, or -1 if the subtree breaks the key order,
+	// the fill rules or the equal leaf depth
+	long long checkSubtree(const BPlusNode *node, int level, const int *low, const int *high) const {
+		if (node->leaf != (level == depth) || node->count > MAX_KEYS ||
+		    (node != root && node->count < MIN_KEYS) || node->count == 0) {
+			return -1;
+		}
+		for (int i = 0; i < node->count; i++) {
+			if ((i > 0 && node->keys[i - 1] >= node->keys[i]) || (low != nullptr && node->keys[i] < *low) ||
+			    (high != nullptr && node->keys[i] >= *high)) {
+				return -1;
+			}
+		}
+		for (int i = node->count; i < MAX_KEYS; i++) {
+			if (node->keys[i] != INT_MAX) {
+				return -1;
+			}
+		}
+		long long copies = 0;
+		if (node->leaf) {
+			for (int i = 0; i < node->count; i++) {
+				copies += static_cast<const BPlusLeaf *>(node)->copies[i];
+			}
+			return copies;
+		}
+		const BPlusInner *inner = static_cast<const BPlusInner *>(node);
+		for (int i = 0; i <= inner->count; i++) {
+			long long below = checkSubtree(inner->children[i], level + 1, i == 0 ? low : &inner->keys[i - 1],
+			                               i == inner->count ? high : &inner->keys[i]);
+			if (below == -1) {
+				return -1;
+			}
+			copies += below;
+		}
+		return copies;
+	}
+
+public:
+	BPlusTree() = default;
+	BPlusTree(const BPlusTree &) = delete;
+	BPlusTree &operator=(const BPlusTree &) = delete;
+
+	bool contains(int k) const {
+		if (root == nullptr) {
+			return false;
+		}
+		const BPlusNode *node = root;
+		for (int i = 0; i < depth; i++) {
+			node = static_cast<const BPlusInner *>(node)->children[countUpTo(node, k)];
+		}
+		int pos = countBelow(node, k);
+		return pos < node->count && node->keys[pos] == k;
+	}
+
+	void insert(int k) {
+		total++;
+		if (root == nullptr) {
+			BPlusLeaf *leaf = newLeaf();
+			insertAt(leaf, 0, k, 1);
+			root = leaf;
+			return;
+		}
+
+		BPlusLeaf *leaf = findLeaf(k);
+		int pos = countBelow(leaf, k);
+		if (pos < leaf->count && leaf->keys[pos] == k) {
+			leaf->copies[pos]++;
+			return;
+		}
+		if (leaf->count < MAX_KEYS) {
+			insertAt(leaf, pos, k, 1);
+			return;
+		}
+
+		// split the full leaf in half and put k in its side
+		BPlusLeaf *right = newLeaf();
+		for (int j = MIN_KEYS; j < MAX_KEYS; j++) {
+			insertAt(right, right->count, leaf->keys[j], leaf->copies[j]);
+		}
+		truncate(leaf, MIN_KEYS);
+		if (pos <= MIN_KEYS) {
+			insertAt(leaf, pos, k, 1);
+		} else {
+			insertAt(right, pos - MIN_KEYS, k, 1);
+		}
+		insertChild(depth - 1, right->keys[0], right);
+	}
+
+	// removes one copy of k; false if k was not in the tree
+	bool deleteNode(int k) {
+		if (root == nullptr) {
+			return false;
+		}
+		BPlusLeaf *leaf = findLeaf(k);
+		int pos = countBelow(leaf, k);
+		if (pos == leaf->count || leaf->keys[pos] != k) {
+			return false;
+		}
+		total--;
+		if (--leaf->copies[pos] == 0) {
+			removeAt(leaf, pos);
+			rebalance(leaf);
+		}
+		return true;
+	}
+
+	// checks key order and separator bounds, the INT_MAX padding,
+	// that every node but the root is at least half full, that all
+	// leaves are equally deep, and that the copies add up to size()
+	bool isValid() const {
+		if (root == nullptr) {
+			return total == 0 && depth == 0;
+		}
+		return checkSubtree(root, 0, nullptr, nullptr) == (long long)total;
+	}
+
+	size_t size() const {
+		return total;
+	}
+
+	// levels from the root down to the leaves, counting both
+	int height() const {
+		return root == nullptr ? 0 : depth + 1;
+	}
+
+	size_t calculateMemoryUsage() const {
+		return leaves.liveNodes() * sizeof(BPlusLeaf) + inners.liveNodes() * sizeof(BPlusInner);
+	}
+};
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef COMPACT_RBTREE_HPP
+#define COMPACT_RBTREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// A 16 byte node: children and parent are 32-bit indices into the
+// tree's node array, and the color lives in the low bit of the
+// parent word. Index 0 is the TNULL sentinel, which also stands in
+// for "no parent" on the root.
+struct CompactNode {
+	int data;
+	uint32_t left;
+	uint32_t right;
+	uint32_t parentColor; // parent index << 1 | color (1 -> Red, 0 -> Black)
+};
+
+static_assert(sizeof(CompactNode) == 16, "CompactNode should pack into 16 bytes");
+
+typedef uint32_t NodeIndex;
+
+// Red-black tree with the same algorithms as RBTree, but over a
+// contiguous array of CompactNodes instead of individually
+// allocated 40 byte Nodes. Four nodes share a cache line, and the
+// whole tree can hold up to 2^31 - 1 keys.
+class CompactRBTree {
+private:
+	static const NodeIndex TNULL = 0;
+
+	std::vector<CompactNode> nodes;
+	NodeIndex root = TNULL;
+	NodeIndex freeList = TNULL; // deleted slots, linked through left
+	size_t count = 0;
+
+	NodeIndex parent(NodeIndex i) const {
+		return nodes[i].parentColor >> 1;
+	}
+
+	void setParent(NodeIndex i, NodeIndex p) {
+		nodes[i].parentColor = (p << 1) | (nodes[i].parentColor & 1);
+	}
+
+	int color(NodeIndex i) const {
+		return nodes[i].parentColor & 1;
+	}
+
+	void setColor(NodeIndex i, int c) {
+		nodes[i].parentColor = (nodes[i].parentColor & ~(uint32_t)1) | (uint32_t)c;
+	}
+
+	NodeIndex &left(NodeIndex i) {
+		return nodes[i].left;
+	}
+
+	NodeIndex &right(NodeIndex i) {
+		return nodes[i].right;
+	}
+
+	NodeIndex allocateNode(int key) {
+		NodeIndex i;
+		if (freeList != TNULL) {
+			i = freeList;
+			freeList = nodes[i].left;
+		} else {
+			i = (NodeIndex)nodes.size();
+			nodes.push_back(CompactNode{});
+		}
+		nodes[i].data = key;
+		nodes[i].left = TNULL;
+		nodes[i].right = TNULL;
+		nodes[i].parentColor = 1; // no parent, red
+		return i;
+	}
+
+	void freeNode(NodeIndex i) {
+		nodes[i].left = freeList;
+		freeList = i;
+	}
+
+	void leftRotate(NodeIndex x) {
+		NodeIndex y = right(x);
+		right(x) = left(y);
+		if (left(y) != TNULL) {
+			setParent(left(y), x);
+		}
+		setParent(y, parent(x));
+		if (parent(x) == TNULL) {
+			root = y;
+		} else if (x == left(parent(x))) {
+			left(parent(x)) = y;
+		} else {
+			right(parent(x)) = y;
+		}
+		left(y) = x;
+		setParent(x, y);
+	}
+
+	void rightRotate(NodeIndex x) {
+		NodeIndex y = left(x);
+		left(x) = right(y);
+		if (right(y) != TNULL) {
+			setParent(right(y), x);
+		}
+		setParent(y, parent(x));
+		if (parent(x) == TNULL) {
+			root = y;
+		} else if (x == right(parent(x))) {
+			right(parent(x)) = y;
+		} else {
+			left(parent(x)) = y;
+		}
+		right(y) = x;
+		setParent(x, y);
+	}
+
+	void fixInsert(NodeIndex k) {
+		NodeIndex u;
+		while (color(parent(k)) == 1) {
+			NodeIndex p = parent(k), g = parent(p);
+			if (p == right(g)) {
+				u = left(g); // uncle
+				if (color(u) == 1) {
+					setColor(u, 0);
+					setColor(p, 0);
+					setColor(g, 1);
+					k = g;
+				} else {
+					if (k == left(p)) {
+						k = p;
+						rightRotate(k);
+					}
+					setColor(parent(k), 0);
+					setColor(parent(parent(k)), 1);
+					leftRotate(parent(parent(k)));
+				}
+			} else {
+				u = right(g); // uncle
+				if (color(u) == 1) {
+					setColor(u, 0);
+					setColor(p, 0);
+					setColor(g, 1);
+					k = g;
+				} else {
+					if (k == right(p)) {
+						k = p;
+						leftRotate(k);
+					}
+					setColor(parent(k), 0);
+					setColor(parent(parent(k)), 1);
+					rightRotate(parent(parent(k)));
+				}
+			}
+			if (k == root) {
+				break;
+			}
+		}
+		setColor(root, 0);
+	}
+
+	void fixDelete(NodeIndex x) {
+		NodeIndex s;
+		while (x != root && color(x) == 0) {
+			if (x == left(parent(x))) {
+				s = right(parent(x));
+				if (color(s) == 1) {
+					setColor(s, 0);
+					setColor(parent(x), 1);
+					leftRotate(parent(x));
+					s = right(parent(x));
+				}
+
+				if (color(left(s)) == 0 && color(right(s)) == 0) {
+					setColor(s, 1);
+					x = parent(x);
+				} else {
+					if (color(right(s)) == 0) {
+						setColor(left(s), 0);
+						setColor(s, 1);
+						rightRotate(s);
+						s = right(parent(x));
+					}
+					setColor(s, color(parent(x)));
+					setColor(parent(x), 0);
+					setColor(right(s), 0);
+					leftRotate(parent(x));
+					x = root;
+				}
+			} else {
+				s = left(parent(x));
+				if (color(s) == 1) {
+					setColor(s, 0);
+					setColor(parent(x), 1);
+					rightRotate(parent(x));
+					s = left(parent(x));
+				}
+
+				if (color(left(s)) == 0 && color(right(s)) == 0) {
+					setColor(s, 1);
+					x = parent(x);
+				} else {
+					if (color(left(s)) == 0) {
+						setColor(right(s), 0);
+						setColor(s, 1);
+						leftRotate(s);
+						s = left(parent(x));
+					}
+					setColor(s, color(parent(x)));
+					setColor(parent(x), 0);
+					setColor(left(s), 0);
+					rightRotate(parent(x));
+					x = root;
+				}
+			}
+		}
+		setColor(x, 0);
+	}
+
+	void rbTransplant(NodeIndex u, NodeIndex v) {
+		if (parent(u) == TNULL) {
+			root = v;
+		} else if (u == left(parent(u))) {
+			left(parent(u)) = v;
+		} else {
+			right(parent(u)) = v;
+		}
+		setParent(v, parent(u));
+	}
+
+	// Returns the black height of the subtree at node, or -1 if it
+	// breaks BST order, has a red node with a red child or unequal
+	// black heights, or holds a child whose parent index is not
+	// node. Counts the nodes it visits into seen, and gives up once
+	// there are more than count of them, so a cycle cannot recurse
+	// forever.
+	int checkSubtree(NodeIndex node, const int *low, const int *high, size_t &seen) const {
+		if (node == TNULL) {
+			return 1;
+		}
+		if (node >= nodes.size() || ++seen > count) {
+			return -1;
+		}
+		const CompactNode &n = nodes[node];
+		if ((low != nullptr && n.data < *low) || (high != nullptr && n.data > *high)) {
+			return -1;
+		}
+		if ((n.left != TNULL && parent(n.left) != node) || (n.right != TNULL && parent(n.right) != node)) {
+			return -1;
+		}
+		if (color(node) == 1 && (color(n.left) == 1 || color(n.right) == 1)) {
+			return -1;
+		}
+		int leftHeight = checkSubtree(n.left, low, &n.data, seen);
+		int rightHeight = checkSubtree(n.right, &n.data, high, seen);
+		if (leftHeight == -1 || leftHeight != rightHeight) {
+			return -1;
+		}
+		return leftHeight + (color(node) == 0 ? 1 : 0);
+	}
+
+	// as RBTree::validate: checks the tree after every change when
+	// RBTREE_VALIDATE is defined, and is empty otherwise
+	void validate() const {
+#ifdef RBTREE_VALIDATE
+		if (!isValid()) {
+			throw std::logic_error("CompactRBTree invariant broken");
+		}
+#endif
+	}
+
+public:
+	CompactRBTree() {
+		// slot 0 is TNULL: black, no children
+		nodes.push_back(CompactNode{0, TNULL, TNULL, 0});
+	}
+
+	// reserve room for n keys up front
+	void reserve(size_t n) {
+		nodes.reserve(n + 1);
+	}
+
+	// returns the index of a node holding k, or TNULL
+	NodeIndex searchTree(int k) const {
+		NodeIndex node = root;
+		while (node != TNULL && k != nodes[node].data) {
+			node = k < nodes[node].data ? nodes[node].left : nodes[node].right;
+		}
+		return node;
+	}
+
+	bool contains(int k) const {
+		return searchTree(k) != TNULL;
+	}
+
+	NodeIndex minimum(NodeIndex node) {
+		while (left(node) != TNULL) {
+			node = left(node);
+		}
+		return node;
+	}
+
+	NodeIndex maximum(NodeIndex node) {
+		while (right(node) != TNULL) {
+			node = right(node);
+		}
+		return node;
+	}
+
+	int key(NodeIndex i) const {
+		return nodes[i].data;
+	}
+
+	NodeIndex getRoot() const {
+		return root;
+	}
+
+	void insert(int key) {
+		NodeIndex node = allocateNode(key);
+		NodeIndex y = TNULL;
+		NodeIndex x = root;
+
+		while (x != TNULL) {
+			y = x;
+			x = key < nodes[x].data ? left(x) : right(x);
+		}
+
+		setParent(node, y);
+		if (y == TNULL) {
+			root = node;
+		} else if (key < nodes[y].data) {
+			left(y) = node;
+		} else {
+			right(y) = node;
+		}
+		count++;
+
+		if (parent(node) == TNULL) {
+			setColor(node, 0);
+		} else if (parent(parent(node)) != TNULL) {
+			fixInsert(node);
+		}
+		validate();
+	}
+
+	// returns false if key was not in the tree
+	bool deleteNode(int key) {
+		NodeIndex z = searchTree(key);
+		NodeIndex x, y;
+		if (z == TNULL) {
+			return false;
+		}
+
+		y = z;
+		int y_original_color = color(y);
+		if (left(z) == TNULL) {
+			x = right(z);
+			rbTransplant(z, right(z));
+		} else if (right(z) == TNULL) {
+			x = left(z);
+			rbTransplant(z, left(z));
+		} else {
+			y = minimum(right(z));
+			y_original_color = color(y);
+			x = right(y);
+			if (parent(y) == z) {
+				setParent(x, y);
+			} else {
+				rbTransplant(y, right(y));
+				right(y) = right(z);
+				setParent(right(y), y);
+			}
+
+			rbTransplant(z, y);
+			left(y) = left(z);
+			setParent(left(y), y);
+			setColor(y, color(z));
+		}
+		freeNode(z);
+		count--;
+		if (y_original_color == 0) {
+			fixDelete(x);
+		}
+		validate();
+		return true;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	// Checks BST order, a black root without a parent, no red node
+	// with a red child, equal black heights on every path, parent
+	// indices that match the child indices, a black TNULL without
+	// children, and the node count. TNULL's parent index is scratch
+	// space for deleteNode, so it is not checked.
+	bool isValid() const {
+		if (color(TNULL) != 0 || nodes[TNULL].left != TNULL || nodes[TNULL].right != TNULL) {
+			return false;
+		}
+		if (root == TNULL) {
+			return count == 0;
+		}
+		size_t seen = 0;
+		return color(root) == 0 && parent(root) == TNULL && checkSubtree(root, nullptr, nullptr, seen) != -1 &&
+		       seen == count;
+	}
+
+	// bytes held by the node array, including the sentinel and
+	// any deleted slots awaiting reuse
+	size_t calculateMemoryUsage() const {
+		return nodes.size() * sizeof(CompactNode);
+	}
+};
+
+#endif
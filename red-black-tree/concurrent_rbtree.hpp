@@ -0,0 +1,459 @@
+#ifndef CONCURRENT_RBTREE_HPP
+#define CONCURRENT_RBTREE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include "node_pool.hpp"
+#include "rbtree.hpp"
+
+// A node readers may look at while a writer is changing it, so
+// every field they touch is atomic. color is only ever used by the
+// writer holding the lock.
+template <typename Key, typename Value>
+struct ConcurrentNode {
+	std::atomic<Key> key;
+	std::atomic<Value> value;
+	std::atomic<ConcurrentNode *> link[2]; // left, right
+	int color; // 1 -> Red, 0 -> Black
+};
+
+// Red-black map for read-mostly use from many threads.
+// Writers (insert, deleteNode, clear) take a mutex and run the
+// same parent-free algorithms as ParentFreeRBTree. Readers
+// (searchTree, minimum, maximum) take no lock: they note the
+// sequence number, walk the tree, and keep the answer only if no
+// writer ran in the meantime (a seqlock). A walk is cut off after
+// MAX_HEIGHT steps, so a reader caught mid-rotation cannot loop.
+// Readers that keep losing to writers fall back to the mutex.
+//
+// Nodes are never handed back to the allocator while the tree is
+// alive; deleted nodes are reused by later inserts. So a reader
+// holding a stale pointer reads a live (if meaningless) node,
+// which the sequence check then throws away. Keys and values are
+// copied out of nodes which may be changing, so both have to be
+// trivially copyable.
+template <typename Key, typename Value = RBNoValue, typename Compare = std::less<Key>>
+class ConcurrentRBTree {
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+	              "ConcurrentRBTree copies keys and values out of nodes which may be changing");
+
+public:
+	typedef ConcurrentNode<Key, Value> Node;
+
+private:
+	static const int MAX_HEIGHT = 128;
+	static const int LEFT = 0, RIGHT = 1;
+	// optimistic reads tried before a reader takes the mutex
+	static const int OPTIMISTIC_ATTEMPTS = 16;
+
+	std::atomic<Node *> root{nullptr};
+	std::atomic<unsigned long> sequence{0}; // odd while a writer is changing the tree
+	mutable std::mutex writer;
+	mutable std::atomic<unsigned long> fallbacks{0};
+	NodePool<Node> pool;
+	Node *freeNodes = nullptr; // deleted nodes, linked through their left link
+	Compare comp;
+	size_t count = 0;
+
+	// the root-to-node path of the current write; dir[i] is which
+	// child of path[i] the path continues into
+	Node *path[MAX_HEIGHT + 1];
+	int dir[MAX_HEIGHT + 1];
+
+	// Every field readers look at is stored with release and loaded
+	// with acquire (both plain moves on x86). So a reader which
+	// reaches a node sees it initialized, and none of a reader's
+	// loads can drift past its final look at the sequence number.
+	static Node *load(const std::atomic<Node *> &link) {
+		return link.load(std::memory_order_acquire);
+	}
+
+	static Node *child(Node *node, int d) {
+		return load(node->link[d]);
+	}
+
+	static void setChild(Node *node, int d, Node *to) {
+		node->link[d].store(to, std::memory_order_release);
+	}
+
+	static Key key(const Node *node) {
+		return node->key.load(std::memory_order_acquire);
+	}
+
+	static bool isRed(Node *node) {
+		return node != nullptr && node->color == 1;
+	}
+
+	// everything a write does happens between these two
+	void beginWrite() {
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void endWrite() {
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Runs walk(result) without the lock until it completes with no
+	// writer in the way, then under the lock if that keeps failing.
+	// walk returns false if it gave up after MAX_HEIGHT steps.
+	template <typename Result, typename Walk>
+	Result read(Walk walk) const {
+		Result result{};
+		for (int attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; attempt++) {
+			unsigned long before = sequence.load(std::memory_order_acquire);
+			if (before & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			bool complete = walk(result);
+			if (complete && sequence.load(std::memory_order_relaxed) == before) {
+				return result;
+			}
+		}
+
+		fallbacks.fetch_add(1, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(writer);
+		walk(result);
+		return result;
+	}
+
+	Node *allocateNode(const Key &k, const Value &value) {
+		Node *node;
+		if (freeNodes != nullptr) {
+			node = freeNodes;
+			freeNodes = child(node, LEFT);
+		} else {
+			node = new (pool.allocate()) Node();
+		}
+		node->key.store(k, std::memory_order_release);
+		node->value.store(value, std::memory_order_release);
+		setChild(node, LEFT, nullptr);
+		setChild(node, RIGHT, nullptr);
+		node->color = 1; // new node must be red
+		return node;
+	}
+
+	// nodes stay readable after deletion, so they go on our own free
+	// list rather than back to the pool (whose list would overwrite them)
+	void freeNode(Node *node) {
+		setChild(node, LEFT, freeNodes);
+		freeNodes = node;
+	}
+
+	// rotates x down toward side d, returning the child which
+	// took its place: rotate(x, LEFT) is a left rotation
+	static Node *rotate(Node *x, int d) {
+		Node *y = child(x, !d);
+		setChild(x, !d, child(y, d));
+		setChild(y, d, x);
+		return y;
+	}
+
+	// points whatever held path[i] at node instead
+	void relink(int i, Node *node) {
+		if (i == 0) {
+			root.store(node, std::memory_order_release);
+		} else {
+			setChild(path[i - 1], dir[i - 1], node);
+		}
+	}
+
+	// the new node is child dir[depth - 1] of path[depth - 1]
+	void fixInsert(int depth) {
+		int i = depth - 1; // index of the red node's parent
+		while (i >= 1 && isRed(path[i])) {
+			Node *p = path[i];
+			Node *g = path[i - 1];
+			int pd = dir[i - 1]; // p is g's pd child
+			Node *u = child(g, !pd); // uncle
+
+			if (isRed(u)) {
+				// case 3.1: recolor and continue from g
+				p->color = 0;
+				u->color = 0;
+				g->color = 1;
+				i -= 2;
+				continue;
+			}
+
+			if (dir[i] != pd) {
+				// case 3.2.2: straighten the zig-zag
+				setChild(g, pd, rotate(p, pd));
+				p = child(g, pd);
+			}
+
+			// case 3.2.1
+			p->color = 0;
+			g->color = 1;
+			relink(i - 1, rotate(g, !pd));
+			break;
+		}
+		load(root)->color = 0;
+	}
+
+	// path[i] has lost a black node from its dir[i] side
+	void fixDelete(int i) {
+		while (i >= 0) {
+			Node *p = path[i];
+			int d = dir[i];
+			Node *x = child(p, d);
+			Node *s = child(p, !d);
+
+			if (isRed(x)) {
+				x->color = 0;
+				return;
+			}
+
+			if (isRed(s)) {
+				// case 3.1: make the sibling black, pushing s
+				// onto the path above p
+				s->color = 0;
+				p->color = 1;
+				relink(i, rotate(p, d));
+				path[i] = s;
+				dir[i] = d;
+				path[i + 1] = p;
+				dir[i + 1] = d;
+				i++;
+				s = child(p, !d);
+			}
+
+			if (!isRed(child(s, LEFT)) && !isRed(child(s, RIGHT))) {
+				// case 3.2: push the missing black up a level
+				s->color = 1;
+				if (p->color == 1) {
+					p->color = 0;
+					return;
+				}
+				i--;
+				continue;
+			}
+
+			if (!isRed(child(s, !d))) {
+				// case 3.3
+				child(s, d)->color = 0;
+				s->color = 1;
+				s = rotate(s, !d);
+				setChild(p, !d, s);
+			}
+
+			// case 3.4
+			s->color = p->color;
+			p->color = 0;
+			child(s, !d)->color = 0;
+			relink(i, rotate(p, d));
+			return;
+		}
+	}
+
+public:
+	ConcurrentRBTree() = default;
+	ConcurrentRBTree(const ConcurrentRBTree &) = delete;
+	ConcurrentRBTree &operator=(const ConcurrentRBTree &) = delete;
+
+	// Lock-free lookup. Copies the value out if value is not null.
+	bool searchTree(const Key &k, Value *value = nullptr) const {
+		struct Found {
+			bool found;
+			Value value;
+		};
+		Found out = read<Found>([&](Found &result) {
+			// Descends like lower_bound, one comparison per level and
+			// no early exit, so the choice of link is a conditional
+			// move rather than a branch the CPU keeps mispredicting
+			Node *node = load(root);
+			Node *candidate = nullptr; // lowest node seen with key >= k
+			Key candidateKey = Key();
+			for (int steps = 0; node != nullptr; steps++) {
+				if (steps > MAX_HEIGHT) {
+					return false;
+				}
+				Key here = key(node);
+				bool goRight = comp(here, k);
+				if (!goRight) {
+					candidate = node;
+					candidateKey = here;
+				}
+				node = child(node, goRight ? RIGHT : LEFT);
+			}
+			result.found = candidate != nullptr && !comp(k, candidateKey);
+			if (result.found) {
+				result.value = candidate->value.load(std::memory_order_acquire);
+			}
+			return true;
+		});
+		if (out.found && value != nullptr) {
+			*value = out.value;
+		}
+		return out.found;
+	}
+
+	bool contains(const Key &k) const {
+		return searchTree(k);
+	}
+
+	// Lock-free; false if the tree is empty
+	bool minimum(Key &out) const {
+		return extreme(LEFT, out);
+	}
+
+	bool maximum(Key &out) const {
+		return extreme(RIGHT, out);
+	}
+
+	// inserts k if it is not already there; false if it was
+	bool insert(const Key &k, const Value &value = Value()) {
+		std::lock_guard<std::mutex> lock(writer);
+		int depth = 0;
+		for (Node *x = load(root); x != nullptr; depth++) {
+			Key here = key(x);
+			if (!comp(k, here) && !comp(here, k)) {
+				return false;
+			}
+			path[depth] = x;
+			dir[depth] = comp(k, here) ? LEFT : RIGHT;
+			x = child(x, dir[depth]);
+		}
+
+		beginWrite();
+		Node *node = allocateNode(k, value);
+		count++;
+		if (depth == 0) {
+			node->color = 0;
+			root.store(node, std::memory_order_release);
+		} else {
+			setChild(path[depth - 1], dir[depth - 1], node);
+			fixInsert(depth);
+		}
+		endWrite();
+		return true;
+	}
+
+	// returns false if k was not in the tree
+	bool deleteNode(const Key &k) {
+		std::lock_guard<std::mutex> lock(writer);
+		int depth = 0;
+		Node *z = load(root);
+		while (z != nullptr) {
+			Key here = key(z);
+			if (!comp(k, here) && !comp(here, k)) {
+				break;
+			}
+			path[depth] = z;
+			dir[depth] = comp(k, here) ? LEFT : RIGHT;
+			z = child(z, dir[depth]);
+			depth++;
+		}
+		if (z == nullptr) {
+			return false;
+		}
+
+		beginWrite();
+		// with two children, take the successor's entry and remove
+		// the successor instead, which has no left child
+		Node *m = z;
+		if (child(z, LEFT) != nullptr && child(z, RIGHT) != nullptr) {
+			path[depth] = z;
+			dir[depth] = RIGHT;
+			depth++;
+			m = child(z, RIGHT);
+			while (child(m, LEFT) != nullptr) {
+				path[depth] = m;
+				dir[depth] = LEFT;
+				depth++;
+				m = child(m, LEFT);
+			}
+			z->key.store(key(m), std::memory_order_release);
+			z->value.store(m->value.load(std::memory_order_relaxed), std::memory_order_release);
+		}
+
+		Node *c = child(m, LEFT) != nullptr ? child(m, LEFT) : child(m, RIGHT);
+		relink(depth, c);
+		int removedColor = m->color;
+		freeNode(m);
+		count--;
+
+		if (removedColor == 0) {
+			if (depth == 0) {
+				// removed the root; its child (if any) is the new root
+				if (load(root) != nullptr) {
+					load(root)->color = 0;
+				}
+			} else {
+				fixDelete(depth - 1);
+			}
+		}
+		endWrite();
+		return true;
+	}
+
+	// empties the tree, keeping every node for reuse so that
+	// readers still walking it stay inside live memory
+	void clear() {
+		std::lock_guard<std::mutex> lock(writer);
+		beginWrite();
+		Node *stack[MAX_HEIGHT + 1];
+		int top = 0;
+		if (load(root) != nullptr) {
+			stack[top++] = load(root);
+		}
+		root.store(nullptr, std::memory_order_release);
+		while (top > 0) {
+			// a node's children are pushed before freeNode reuses left
+			Node *node = stack[--top];
+			if (child(node, RIGHT) != nullptr) {
+				stack[top++] = child(node, RIGHT);
+			}
+			if (child(node, LEFT) != nullptr) {
+				stack[top++] = child(node, LEFT);
+			}
+			freeNode(node);
+		}
+		count = 0;
+		endWrite();
+	}
+
+	size_t size() const {
+		std::lock_guard<std::mutex> lock(writer);
+		return count;
+	}
+
+	// reads which gave up on the optimistic path and took the lock
+	unsigned long lockedReads() const {
+		return fallbacks.load(std::memory_order_relaxed);
+	}
+
+	size_t calculateMemoryUsage() const {
+		return pool.reservedBytes();
+	}
+
+private:
+	bool extreme(int d, Key &out) const {
+		struct Found {
+			bool found;
+			Key key;
+		};
+		Found result = read<Found>([&](Found &found) {
+			Node *node = load(root);
+			found.found = node != nullptr;
+			for (int steps = 0; node != nullptr; steps++) {
+				if (steps > MAX_HEIGHT) {
+					return false;
+				}
+				found.key = key(node);
+				node = child(node, d);
+			}
+			return true;
+		});
+		if (result.found) {
+			out = result.key;
+		}
+		return result.found;
+	}
+};
+
+#endif
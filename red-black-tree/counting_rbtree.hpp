@@ -0,0 +1,128 @@
+#ifndef COUNTING_RBTREE_HPP
+#define COUNTING_RBTREE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include "rbtree.hpp"
+
+// Multiset which keeps each distinct key once, next to the number
+// of times it occurs. RBTree's own insert(key) gives every copy of a
+// key its own node, so a million keys drawn from ten thousand values
+// make a million-node tree; here they make a ten-thousand-node one.
+// Inserting a key which is already there, or deleting one copy of a
+// key which has others, only changes its count: the tree is searched
+// but never rebalanced. Count is the type the counts are kept in;
+// with int keys the default unsigned keeps nodes at 40 bytes.
+template <typename Key, typename Compare = std::less<Key>, typename Count = unsigned,
+          typename Allocator = std::allocator<std::pair<const Key, Count>>, bool TrackStats = false>
+class CountingRBTree {
+public:
+	typedef RBTree<Key, Count, Compare, Allocator, TrackStats> Tree;
+	typedef typename Tree::Node Node; // kv.second is the key's count
+	typedef typename Tree::const_iterator const_iterator;
+
+private:
+	Tree tree;
+	size_t total = 0; // occurrences across all keys
+
+public:
+	CountingRBTree() = default;
+
+	explicit CountingRBTree(const Compare &compare, const Allocator &allocator = Allocator())
+	    : tree(compare, allocator) {}
+
+	// adds n copies of k, returning how many there are now
+	Count insert(const Key &k, Count n = 1) {
+		Count &count = tree.try_emplace(k, Count()).first->second;
+		count += n;
+		total += n;
+		return count;
+	}
+
+	// removes one copy of k; false if k was not in the tree
+	bool deleteNode(const Key &k) {
+		auto it = tree.find(k);
+		if (it == tree.end()) {
+			return false;
+		}
+		total--;
+		if (--it->second == 0) {
+			tree.erase(it);
+		}
+		return true;
+	}
+
+	// removes every copy of k, returning how many there were
+	Count erase(const Key &k) {
+		auto it = tree.find(k);
+		if (it == tree.end()) {
+			return 0;
+		}
+		Count removed = it->second;
+		total -= removed;
+		tree.erase(it);
+		return removed;
+	}
+
+	// the node holding k and its count, or nullptr
+	const Node *searchTree(const Key &k) {
+		return tree.searchTree(k);
+	}
+
+	Count count(const Key &k) const {
+		auto it = tree.find(k);
+		return it == tree.end() ? Count() : it->second;
+	}
+
+	bool contains(const Key &k) const {
+		return tree.find(k) != tree.end();
+	}
+
+	// in key order, one (key, count) pair per distinct key
+	const_iterator begin() const {
+		return tree.begin();
+	}
+
+	const_iterator end() const {
+		return tree.end();
+	}
+
+	// occurrences, counting every copy
+	size_t size() const {
+		return total;
+	}
+
+	size_t distinctKeys() const {
+		return tree.size();
+	}
+
+	bool empty() const {
+		return total == 0;
+	}
+
+	void clear() {
+		tree.clear();
+		total = 0;
+	}
+
+	unsigned long long comparisons() const {
+		return tree.comparisons();
+	}
+
+	void resetStats() {
+		tree.resetStats();
+	}
+
+	size_t calculateMemoryUsage() {
+		return tree.calculateMemoryUsage();
+	}
+
+	// bytes the node pool has reserved, including free slots
+	size_t reservedBytes() const {
+		return tree.reservedBytes();
+	}
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef MAPPED_RBTREE_HPP
+#define MAPPED_RBTREE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rbtree.hpp"
+
+// Read-only view of a file written by RBTree::save, used where it
+// lies: the file is mapped into memory and searched through its
+// index links, with nothing read ahead or copied. Opening one costs
+// a header check however big the tree is, and the pages a lookup
+// touches are read in by the OS on first use and shared with every
+// other process mapping the same file.
+//
+// The nodes are stored in key order, so a node's index is its rank,
+// and range scans walk the array front to back. Key, Value and
+// Compare must be those of the tree that was saved.
+template <typename Key, typename Value = RBNoValue, typename Compare = std::less<Key>>
+class MappedRBTree {
+public:
+	typedef RBFileNode<Key, Value> Node;
+
+private:
+	const void *mapping = nullptr;
+	size_t mappedBytes = 0;
+	const Node *nodes = nullptr;
+	size_t count = 0;
+	uint32_t root = RB_FILE_NIL;
+	Compare comp;
+
+	[[noreturn]] static void fail(const std::string &path, const std::string &what) {
+		throw std::runtime_error("MappedRBTree: " + path + ": " + what);
+	}
+
+	void unmap() {
+		if (mapping != nullptr) {
+			munmap(const_cast<void *>(mapping), mappedBytes);
+		}
+		mapping = nullptr;
+		nodes = nullptr;
+		mappedBytes = count = 0;
+		root = RB_FILE_NIL;
+	}
+
+public:
+	// Maps the file at path. Throws runtime_error if it cannot be
+	// mapped or was not saved from an RBTree<Key, Value>. Lookups
+	// never leave the file, but the links are not otherwise checked,
+	// so the file should come from RBTree::save.
+	explicit MappedRBTree(const std::string &path, const Compare &compare = Compare()) : comp(compare) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			fail(path, std::strerror(errno));
+		}
+		struct stat status;
+		if (fstat(fd, &status) != 0) {
+			int error = errno;
+			close(fd);
+			fail(path, std::strerror(error));
+		}
+		mappedBytes = status.st_size;
+		if (mappedBytes < sizeof(RBFileHeader)) {
+			close(fd);
+			fail(path, "not an RBTREE file");
+		}
+		void *mapped = mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+		int error = errno;
+		close(fd); // the mapping keeps the file open
+		if (mapped == MAP_FAILED) {
+			fail(path, std::strerror(error));
+		}
+		mapping = mapped;
+
+		const RBFileHeader *header = static_cast<const RBFileHeader *>(mapping);
+		std::string problem;
+		if (std::memcmp(header->magic, RB_FILE_MAGIC, sizeof(header->magic)) != 0) {
+			problem = "not an RBTREE file";
+		} else if (header->version != RB_FILE_VERSION || header->nodeSize != sizeof(Node) ||
+		           header->keySize != sizeof(Key)) {
+			problem = "saved with another version, key or value type";
+		} else if (header->count > (mappedBytes - sizeof(RBFileHeader)) / sizeof(Node) ||
+		           (header->count > 0 && header->root >= header->count)) {
+			problem = "file is truncated or damaged";
+		}
+		if (!problem.empty()) {
+			unmap();
+			fail(path, problem);
+		}
+		count = header->count;
+		root = header->root;
+		nodes = reinterpret_cast<const Node *>(static_cast<const char *>(mapping) + sizeof(RBFileHeader));
+	}
+
+	MappedRBTree(const MappedRBTree &) = delete;
+	MappedRBTree &operator=(const MappedRBTree &) = delete;
+
+	MappedRBTree(MappedRBTree &&other) noexcept
+	    : mapping(other.mapping), mappedBytes(other.mappedBytes), nodes(other.nodes), count(other.count),
+	      root(other.root), comp(other.comp) {
+		other.mapping = nullptr;
+		other.unmap();
+	}
+
+	~MappedRBTree() {
+		unmap();
+	}
+
+	// the node holding k, or nullptr
+	const Node *searchTree(const Key &k) const {
+		// RB_FILE_NIL, like any link out of range, is past the end
+		for (size_t i = root; i < count;) {
+			const Node &node = nodes[i];
+			if (comp(k, node.key)) {
+				i = node.left;
+			} else if (comp(node.key, k)) {
+				i = node.right;
+			} else {
+				return &node;
+			}
+		}
+		return nullptr;
+	}
+
+	bool contains(const Key &k) const {
+		return searchTree(k) != nullptr;
+	}
+
+	// rank of the first key not less than k, or size() if none is
+	size_t lowerBound(const Key &k) const {
+		size_t result = count;
+		for (size_t i = root; i < count;) {
+			if (!comp(nodes[i].key, k)) {
+				result = i;
+				i = nodes[i].left;
+			} else {
+				i = nodes[i].right;
+			}
+		}
+		return result;
+	}
+
+	// Calls visit(node) for every node with low <= key < high, in
+	// key order: a lookup, then a walk along the array.
+	template <typename Visit>
+	void rangeScan(const Key &low, const Key &high, Visit visit) const {
+		for (size_t i = lowerBound(low); i < count && comp(nodes[i].key, high); i++) {
+			visit(nodes[i]);
+		}
+	}
+
+	// the node of rank i
+	const Node &select(size_t i) const {
+		return nodes[i];
+	}
+
+	const Node *begin() const {
+		return nodes;
+	}
+
+	const Node *end() const {
+		return nodes + count;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	// bytes of the file mapped
+	size_t mappedSize() const {
+		return mappedBytes;
+	}
+};
+
+#endif
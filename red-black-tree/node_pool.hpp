@@ -0,0 +1,221 @@
+#ifndef NODE_POOL_HPP
+#define NODE_POOL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Slab allocator for fixed-size tree nodes.
+// Nodes are carved out of large chunks in order, so consecutive
+// allocations sit next to each other in memory. Freed nodes go on
+// an intrusive free list (the link is stored inside the dead node
+// itself) and are handed out again before the chunk is extended.
+// Releasing the pool frees whole chunks, so it costs O(chunks)
+// rather than O(nodes). The pool never runs destructors; that is
+// up to the owner. Chunks come from Allocator, rebound to slots.
+//
+// Chunks are grouped into reference-counted arenas so that nodes
+// can change hands between pools: adopt() takes over another
+// pool's memory and share() makes a pool which keeps this one's
+// memory alive. Memory goes back to Allocator once no pool refers
+// to it. A slot may be deallocated into any pool which keeps its
+// memory alive.
+template <typename T, typename Allocator = std::allocator<T>>
+class NodePool {
+private:
+	union Slot {
+		Slot *next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Slot> SlotAllocator;
+	typedef std::allocator_traits<SlotAllocator> SlotTraits;
+
+	// chunks which are freed together
+	struct Arena {
+		SlotAllocator alloc;
+		std::vector<std::pair<Slot *, size_t>> chunks; // start and slot count
+
+		explicit Arena(const SlotAllocator &allocator) : alloc(allocator) {}
+		Arena(const Arena &) = delete;
+		Arena &operator=(const Arena &) = delete;
+
+		~Arena() {
+			for (auto &chunk : chunks) {
+				SlotTraits::deallocate(alloc, chunk.first, chunk.second);
+			}
+		}
+	};
+
+	static const size_t FIRST_CHUNK = 8;
+	static const size_t LARGEST_CHUNK = 65536;
+
+	SlotAllocator alloc;
+	std::shared_ptr<Arena> arena; // where new chunks go
+	std::vector<std::shared_ptr<Arena>> kept; // adopted from or shared with other pools
+	Slot *chunk = nullptr; // the newest chunk
+	Slot *freeList = nullptr;
+	Slot *freeTail = nullptr; // last slot of freeList, so lists can be spliced
+	size_t chunkUsed = 0; // slots handed out from the newest chunk
+	size_t chunkSize = 0; // capacity of the newest chunk
+	size_t reserved = 0;  // slots across all chunks this pool keeps alive
+	size_t live = 0;      // slots currently allocated
+
+	void addChunk(size_t slots) {
+		if (!arena) {
+			arena = std::allocate_shared<Arena>(alloc, alloc);
+		}
+		chunk = SlotTraits::allocate(alloc, slots);
+		arena->chunks.push_back(std::make_pair(chunk, slots));
+		chunkSize = slots;
+		chunkUsed = 0;
+		reserved += slots;
+	}
+
+	// chunks double in size, so n nodes take O(log n) chunks
+	void grow() {
+		size_t slots = chunkSize == 0 ? FIRST_CHUNK : chunkSize * 2;
+		addChunk(slots > LARGEST_CHUNK ? LARGEST_CHUNK : slots);
+	}
+
+	// Holds on to an arena unless this pool already does. A pool
+	// made by share() lists the arenas of the pool it came from, so
+	// without this a split and join would double the list each time.
+	// Returns the slots newly kept alive, 0 if already held.
+	size_t keep(std::shared_ptr<Arena> &&shared) {
+		if (shared == arena || std::find(kept.begin(), kept.end(), shared) != kept.end()) {
+			return 0;
+		}
+		size_t slots = 0;
+		for (auto &chunk : shared->chunks) {
+			slots += chunk.second;
+		}
+		kept.push_back(std::move(shared));
+		return slots;
+	}
+
+public:
+	explicit NodePool(const Allocator &allocator = Allocator()) : alloc(allocator) {}
+
+	NodePool(const NodePool &) = delete;
+	NodePool &operator=(const NodePool &) = delete;
+
+	NodePool(NodePool &&other) noexcept : alloc(other.alloc) {
+		swap(other);
+	}
+
+	NodePool &operator=(NodePool &&other) noexcept {
+		swap(other);
+		return *this;
+	}
+
+	~NodePool() {
+		release();
+	}
+
+	void swap(NodePool &other) noexcept {
+		std::swap(alloc, other.alloc);
+		arena.swap(other.arena);
+		kept.swap(other.kept);
+		std::swap(chunk, other.chunk);
+		std::swap(freeList, other.freeList);
+		std::swap(freeTail, other.freeTail);
+		std::swap(chunkUsed, other.chunkUsed);
+		std::swap(chunkSize, other.chunkSize);
+		std::swap(reserved, other.reserved);
+		std::swap(live, other.live);
+	}
+
+	// returns uninitialized storage for one T
+	T *allocate() {
+		Slot *slot;
+		if (freeList != nullptr) {
+			slot = freeList;
+			freeList = slot->next;
+		} else {
+			if (chunk == nullptr || chunkUsed == chunkSize) {
+				grow();
+			}
+			slot = chunk + chunkUsed++;
+		}
+		live++;
+		return reinterpret_cast<T *>(slot->storage);
+	}
+
+	// the next n allocations come from adjacent slots, as long as
+	// nothing is freed in between and the free list is empty
+	void reserve(size_t n) {
+		if (chunk == nullptr || chunkSize - chunkUsed < n) {
+			addChunk(n);
+		}
+	}
+
+	// returns storage from allocate() to the pool
+	void deallocate(T *node) {
+		Slot *slot = reinterpret_cast<Slot *>(node);
+		if (freeList == nullptr) {
+			freeTail = slot;
+		}
+		slot->next = freeList;
+		freeList = slot;
+		live--;
+	}
+
+	// Takes over all of other's memory, leaving it empty. Its free
+	// slots go ahead of this pool's own.
+	void adopt(NodePool &&other) {
+		if (other.arena) {
+			reserved += keep(std::move(other.arena));
+		}
+		for (auto &shared : other.kept) {
+			reserved += keep(std::move(shared));
+		}
+		if (other.freeList != nullptr) {
+			other.freeTail->next = freeList;
+			if (freeList == nullptr) {
+				freeTail = other.freeTail;
+			}
+			freeList = other.freeList;
+		}
+		live += other.live;
+		other.release();
+	}
+
+	// An empty pool which keeps this pool's memory alive, so that
+	// nodes allocated here can be handed over to it
+	NodePool share() const {
+		NodePool out(alloc);
+		if (arena) {
+			out.kept.push_back(arena);
+		}
+		out.kept.insert(out.kept.end(), kept.begin(), kept.end());
+		return out;
+	}
+
+	// drops this pool's hold on its memory, freeing every chunk no
+	// other pool shares
+	void release() {
+		arena.reset();
+		kept.clear();
+		chunk = nullptr;
+		freeList = freeTail = nullptr;
+		chunkUsed = chunkSize = reserved = live = 0;
+	}
+
+	size_t liveNodes() const {
+		return live;
+	}
+
+	// chunks this pool allocated itself
+	size_t chunkCount() const {
+		return arena ? arena->chunks.size() : 0;
+	}
+
+	size_t reservedBytes() const {
+		return reserved * sizeof(Slot);
+	}
+};
+
+#endif
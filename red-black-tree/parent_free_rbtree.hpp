@@ -0,0 +1,292 @@
+#ifndef PARENT_FREE_RBTREE_HPP
+#define PARENT_FREE_RBTREE_HPP
+
+#include <cstddef>
+#include "node_pool.hpp"
+
+// A 24 byte node with no parent pointer. Leaves are nullptr
+// rather than a shared TNULL sentinel.
+struct PFNode {
+	int data;
+	int color; // 1 -> Red, 0 -> Black
+	PFNode *left;
+	PFNode *right;
+};
+
+// Red-black tree which never stores parent pointers.
+// insert and deleteNode record the root-to-leaf path they walk
+// on a fixed-size stack and rebalance by walking back up it. A
+// red-black tree of n nodes is at most 2 log2(n + 1) tall, so 128
+// entries cover any tree that fits in a 64-bit address space.
+// Rotations rewrite two child links plus the link in the node
+// above, instead of the six pointer writes RBTree needs to also
+// keep parents right.
+class ParentFreeRBTree {
+private:
+	static const int MAX_HEIGHT = 128;
+	static const int LEFT = 0, RIGHT = 1;
+
+	PFNode *root = nullptr;
+	NodePool<PFNode> pool;
+	size_t count = 0;
+
+	// the root-to-node path of the current operation; dir[i] is
+	// which child of path[i] the path continues into
+	PFNode *path[MAX_HEIGHT + 1];
+	int dir[MAX_HEIGHT + 1];
+
+	static bool isRed(PFNode *node) {
+		return node != nullptr && node->color == 1;
+	}
+
+	static PFNode *&child(PFNode *node, int d) {
+		return d == LEFT ? node->left : node->right;
+	}
+
+	// rotates x down toward side d, returning the child which
+	// took its place: rotate(x, LEFT) is a left rotation
+	static PFNode *rotate(PFNode *x, int d) {
+		PFNode *y = child(x, !d);
+		child(x, !d) = child(y, d);
+		child(y, d) = x;
+		return y;
+	}
+
+	// points whatever held path[i] at node instead
+	void relink(int i, PFNode *node) {
+		if (i == 0) {
+			root = node;
+		} else {
+			child(path[i - 1], dir[i - 1]) = node;
+		}
+	}
+
+	// the new node is child dir[depth - 1] of path[depth - 1]
+	void fixInsert(int depth) {
+		int i = depth - 1; // index of the red node's parent
+		while (i >= 1 && isRed(path[i])) {
+			PFNode *p = path[i];
+			PFNode *g = path[i - 1];
+			int pd = dir[i - 1]; // p is g's pd child
+			PFNode *u = child(g, !pd); // uncle
+
+			if (isRed(u)) {
+				// case 3.1: recolor and continue from g
+				p->color = 0;
+				u->color = 0;
+				g->color = 1;
+				i -= 2;
+				continue;
+			}
+
+			if (dir[i] != pd) {
+				// case 3.2.2: straighten the zig-zag
+				child(g, pd) = rotate(p, pd);
+				p = child(g, pd);
+			}
+
+			// case 3.2.1
+			p->color = 0;
+			g->color = 1;
+			relink(i - 1, rotate(g, !pd));
+			break;
+		}
+		root->color = 0;
+	}
+
+	// path[i] has lost a black node from its dir[i] side
+	void fixDelete(int i) {
+		while (i >= 0) {
+			PFNode *p = path[i];
+			int d = dir[i];
+			PFNode *x = child(p, d);
+			PFNode *s = child(p, !d);
+
+			if (isRed(x)) {
+				x->color = 0;
+				return;
+			}
+
+			if (isRed(s)) {
+				// case 3.1: make the sibling black, pushing s
+				// onto the path above p
+				s->color = 0;
+				p->color = 1;
+				relink(i, rotate(p, d));
+				path[i] = s;
+				dir[i] = d;
+				path[i + 1] = p;
+				dir[i + 1] = d;
+				i++;
+				s = child(p, !d);
+			}
+
+			if (!isRed(s->left) && !isRed(s->right)) {
+				// case 3.2: push the missing black up a level
+				s->color = 1;
+				if (p->color == 1) {
+					p->color = 0;
+					return;
+				}
+				i--;
+				continue;
+			}
+
+			if (!isRed(child(s, !d))) {
+				// case 3.3
+				child(s, d)->color = 0;
+				s->color = 1;
+				s = rotate(s, !d);
+				child(p, !d) = s;
+			}
+
+			// case 3.4
+			s->color = p->color;
+			p->color = 0;
+			child(s, !d)->color = 0;
+			relink(i, rotate(p, d));
+			return;
+		}
+	}
+
+	// black height of node, or -1 if its subtree breaks the
+	// ordering or coloring rules
+	int checkSubtree(PFNode *node, const int *low, const int *high) {
+		if (node == nullptr) {
+			return 1;
+		}
+		if ((low != nullptr && node->data < *low) || (high != nullptr && node->data > *high)) {
+			return -1;
+		}
+		if (isRed(node) && (isRed(node->left) || isRed(node->right))) {
+			return -1;
+		}
+		int leftHeight = checkSubtree(node->left, low, &node->data);
+		int rightHeight = checkSubtree(node->right, &node->data, high);
+		if (leftHeight == -1 || leftHeight != rightHeight) {
+			return -1;
+		}
+		return leftHeight + (node->color == 0 ? 1 : 0);
+	}
+
+public:
+	ParentFreeRBTree() = default;
+	ParentFreeRBTree(const ParentFreeRBTree &) = delete;
+	ParentFreeRBTree &operator=(const ParentFreeRBTree &) = delete;
+
+	PFNode *searchTree(int k) const {
+		PFNode *node = root;
+		while (node != nullptr && k != node->data) {
+			node = k < node->data ? node->left : node->right;
+		}
+		return node;
+	}
+
+	PFNode *minimum(PFNode *node) const {
+		while (node->left != nullptr) {
+			node = node->left;
+		}
+		return node;
+	}
+
+	PFNode *maximum(PFNode *node) const {
+		while (node->right != nullptr) {
+			node = node->right;
+		}
+		return node;
+	}
+
+	PFNode *getRoot() const {
+		return root;
+	}
+
+	void insert(int key) {
+		PFNode *node = pool.allocate();
+		node->data = key;
+		node->color = 1; // new node must be red
+		node->left = nullptr;
+		node->right = nullptr;
+		count++;
+
+		int depth = 0;
+		for (PFNode *x = root; x != nullptr; depth++) {
+			path[depth] = x;
+			dir[depth] = key < x->data ? LEFT : RIGHT;
+			x = child(x, dir[depth]);
+		}
+
+		if (depth == 0) {
+			root = node;
+			node->color = 0;
+			return;
+		}
+		child(path[depth - 1], dir[depth - 1]) = node;
+		fixInsert(depth);
+	}
+
+	// returns false if key was not in the tree
+	bool deleteNode(int key) {
+		int depth = 0;
+		PFNode *z = root;
+		while (z != nullptr && z->data != key) {
+			path[depth] = z;
+			dir[depth] = key < z->data ? LEFT : RIGHT;
+			z = child(z, dir[depth]);
+			depth++;
+		}
+		if (z == nullptr) {
+			return false;
+		}
+
+		// with two children, take the successor's key and remove
+		// the successor instead, which has no left child
+		PFNode *m = z;
+		if (z->left != nullptr && z->right != nullptr) {
+			path[depth] = z;
+			dir[depth] = RIGHT;
+			depth++;
+			m = z->right;
+			while (m->left != nullptr) {
+				path[depth] = m;
+				dir[depth] = LEFT;
+				depth++;
+				m = m->left;
+			}
+			z->data = m->data;
+		}
+
+		PFNode *c = m->left != nullptr ? m->left : m->right;
+		relink(depth, c);
+		int removedColor = m->color;
+		pool.deallocate(m);
+		count--;
+
+		if (removedColor == 0) {
+			if (depth == 0) {
+				// removed the root; its child (if any) is the new root
+				if (root != nullptr) {
+					root->color = 0;
+				}
+			} else {
+				fixDelete(depth - 1);
+			}
+		}
+		return true;
+	}
+
+	// checks BST order, no red node with a red child, a black
+	// root, and equal black heights on every path
+	bool isValid() {
+		return !isRed(root) && checkSubtree(root, nullptr, nullptr) != -1;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	size_t calculateMemoryUsage() const {
+		return count * sizeof(PFNode);
+	}
+};
+
+#endif
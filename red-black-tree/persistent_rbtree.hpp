@@ -0,0 +1,482 @@
+#ifndef PERSISTENT_RBTREE_HPP
+#define PERSISTENT_RBTREE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+// Node of a PersistentRBTree. refs counts the links to it: child
+// links from other nodes, plus the roots of trees and snapshots.
+template <typename Key>
+struct PersistentRBNode {
+	Key key;
+	int color; // 1 -> Red, 0 -> Black
+	std::atomic<unsigned> refs;
+	PersistentRBNode *left;
+	PersistentRBNode *right;
+
+	PersistentRBNode(const Key &k, int c, PersistentRBNode *l, PersistentRBNode *r)
+	    : key(k), color(c), refs(1), left(l), right(r) {}
+};
+
+// Red-black tree with O(1) snapshots. snapshot() returns an
+// immutable view of the tree as it is now, sharing every node with
+// it, and the tree goes on changing without disturbing the view.
+//
+// Nodes are reference counted and there are no parent pointers, so
+// one node can sit in any number of trees. insert and deleteNode
+// walk down from the root as ParentFreeRBTree does, and before
+// changing a node they make sure only this tree holds it: a node
+// which some snapshot also reaches is copied first, and the copy
+// takes its place. Each operation copies O(log n) nodes at most (the
+// path plus the siblings rebalancing recolors), and once those are
+// copied, later operations on the same part of the tree change them
+// in place. With no snapshots alive nothing is ever copied, and the
+// tree costs about what ParentFreeRBTree does. A node is freed when
+// the last tree or snapshot holding it lets go.
+//
+// One thread owns the tree and calls snapshot(). Snapshots can be
+// handed to other threads, read there while the tree keeps
+// changing, and dropped in any thread. Equal keys are all kept, as
+// with RBTree's insert(key).
+template <typename Key, typename Compare = std::less<Key>>
+class PersistentRBTree {
+public:
+	typedef PersistentRBNode<Key> Node;
+
+private:
+	static const int MAX_HEIGHT = 128;
+	static const int LEFT = 0, RIGHT = 1;
+
+	static bool isRed(const Node *node) {
+		return node != nullptr && node->color == 1;
+	}
+
+	static Node *&child(Node *node, int d) {
+		return d == LEFT ? node->left : node->right;
+	}
+
+	static void retain(Node *node) {
+		if (node != nullptr) {
+			node->refs.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	// drops one link to node, freeing it and whatever only it
+	// held once no link is left
+	static void release(Node *node) {
+		while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			release(node->left);
+			Node *right = node->right;
+			delete node;
+			node = right;
+		}
+	}
+
+	// First node with key k in the subtree under node, or nullptr.
+	// Shared by the tree and its snapshots.
+	static const Node *find(const Node *node, const Key &k, const Compare &comp) {
+		while (node != nullptr) {
+			if (comp(k, node->key)) {
+				node = node->left;
+			} else if (comp(node->key, k)) {
+				node = node->right;
+			} else {
+				return node;
+			}
+		}
+		return nullptr;
+	}
+
+	// Calls visit(key) for every key under top in order, with a
+	// fixed stack of the nodes still waiting for their right side.
+	template <typename Visit>
+	static void inorder(const Node *top, Visit visit) {
+		const Node *stack[MAX_HEIGHT + 1];
+		int size = 0;
+		for (const Node *node = top; node != nullptr || size > 0;) {
+			if (node != nullptr) {
+				stack[size++] = node;
+				node = node->left;
+			} else {
+				node = stack[--size];
+				visit(node->key);
+				node = node->right;
+			}
+		}
+	}
+
+public:
+	// A read-only view of the tree at the time it was taken. Copying
+	// one is O(1) as well.
+	class Snapshot {
+	private:
+		friend class PersistentRBTree;
+		Node *root = nullptr;
+		size_t count = 0;
+		Compare comp;
+
+		Snapshot(Node *r, size_t n, const Compare &c) : root(r), count(n), comp(c) {
+			retain(root);
+		}
+
+	public:
+		Snapshot() = default;
+
+		Snapshot(const Snapshot &other) : root(other.root), count(other.count), comp(other.comp) {
+			retain(root);
+		}
+
+		Snapshot(Snapshot &&other) noexcept : root(other.root), count(other.count), comp(other.comp) {
+			other.root = nullptr;
+			other.count = 0;
+		}
+
+		Snapshot &operator=(Snapshot other) noexcept {
+			std::swap(root, other.root);
+			std::swap(count, other.count);
+			std::swap(comp, other.comp);
+			return *this;
+		}
+
+		~Snapshot() {
+			release(root);
+		}
+
+		// the first node holding k, or nullptr
+		const Node *searchTree(const Key &k) const {
+			return find(root, k, comp);
+		}
+
+		bool contains(const Key &k) const {
+			return find(root, k, comp) != nullptr;
+		}
+
+		// calls visit(key) for every key, in order
+		template <typename Visit>
+		void forEach(Visit visit) const {
+			inorder(root, visit);
+		}
+
+		const Node *getRoot() const {
+			return root;
+		}
+
+		size_t size() const {
+			return count;
+		}
+
+		bool empty() const {
+			return root == nullptr;
+		}
+	};
+
+private:
+	Node *root = nullptr;
+	Compare comp;
+	size_t count = 0;
+	size_t copied = 0; // nodes copied because a snapshot shared them
+
+	// the root-to-node path of the current operation; dir[i] is
+	// which child of path[i] the path continues into. Every node on
+	// it belongs to this tree alone.
+	Node *path[MAX_HEIGHT + 1];
+	int dir[MAX_HEIGHT + 1];
+
+	// Makes the node link points to this tree's alone, copying it if
+	// anything else holds it, and returns it. link must be root or a
+	// child link of a node this tree already owns, so that a count
+	// of one means this tree's link is the only way to reach it.
+	Node *own(Node *&link) {
+		Node *node = link;
+		if (node != nullptr && node->refs.load(std::memory_order_acquire) != 1) {
+			Node *copy = new Node(node->key, node->color, node->left, node->right);
+			retain(copy->left);
+			retain(copy->right);
+			release(node);
+			link = copy;
+			copied++;
+		}
+		return link;
+	}
+
+	// rotates x down toward side d, returning the child which
+	// took its place. Links only move, so no counts change.
+	static Node *rotate(Node *x, int d) {
+		Node *y = child(x, !d);
+		child(x, !d) = child(y, d);
+		child(y, d) = x;
+		return y;
+	}
+
+	// points whatever held path[i] at node instead
+	void relink(int i, Node *node) {
+		if (i == 0) {
+			root = node;
+		} else {
+			child(path[i - 1], dir[i - 1]) = node;
+		}
+	}
+
+	// the new node is child dir[depth - 1] of path[depth - 1]
+	void fixInsert(int depth) {
+		int i = depth - 1; // index of the red node's parent
+		while (i >= 1 && isRed(path[i])) {
+			Node *p = path[i];
+			Node *g = path[i - 1];
+			int pd = dir[i - 1]; // p is g's pd child
+
+			if (isRed(child(g, !pd))) {
+				// case 3.1: recolor and continue from g
+				Node *u = own(child(g, !pd)); // uncle
+				p->color = 0;
+				u->color = 0;
+				g->color = 1;
+				i -= 2;
+				continue;
+			}
+
+			if (dir[i] != pd) {
+				// case 3.2.2: straighten the zig-zag
+				child(g, pd) = rotate(p, pd);
+				p = child(g, pd);
+			}
+
+			// case 3.2.1
+			p->color = 0;
+			g->color = 1;
+			relink(i - 1, rotate(g, !pd));
+			break;
+		}
+		root->color = 0;
+	}
+
+	// path[i] has lost a black node from its dir[i] side
+	void fixDelete(int i) {
+		while (i >= 0) {
+			Node *p = path[i];
+			int d = dir[i];
+
+			if (isRed(child(p, d))) {
+				own(child(p, d))->color = 0;
+				return;
+			}
+
+			Node *s = own(child(p, !d));
+			if (isRed(s)) {
+				// case 3.1: make the sibling black, pushing s
+				// onto the path above p
+				s->color = 0;
+				p->color = 1;
+				relink(i, rotate(p, d));
+				path[i] = s;
+				dir[i] = d;
+				path[i + 1] = p;
+				dir[i + 1] = d;
+				i++;
+				s = own(child(p, !d));
+			}
+
+			if (!isRed(s->left) && !isRed(s->right)) {
+				// case 3.2: push the missing black up a level
+				s->color = 1;
+				if (p->color == 1) {
+					p->color = 0;
+					return;
+				}
+				i--;
+				continue;
+			}
+
+			if (!isRed(child(s, !d))) {
+				// case 3.3
+				own(child(s, d))->color = 0;
+				s->color = 1;
+				s = rotate(s, !d);
+				child(p, !d) = s;
+			}
+
+			// case 3.4
+			s->color = p->color;
+			p->color = 0;
+			own(child(s, !d))->color = 0;
+			relink(i, rotate(p, d));
+			return;
+		}
+	}
+
+	// black height of node, or -1 if its subtree breaks the
+	// ordering or coloring rules
+	int checkSubtree(const Node *node, const Key *low, const Key *high) const {
+		if (node == nullptr) {
+			return 1;
+		}
+		if ((low != nullptr && comp(node->key, *low)) || (high != nullptr && comp(*high, node->key))) {
+			return -1;
+		}
+		if (isRed(node) && (isRed(node->left) || isRed(node->right))) {
+			return -1;
+		}
+		int leftHeight = checkSubtree(node->left, low, &node->key);
+		int rightHeight = checkSubtree(node->right, &node->key, high);
+		if (leftHeight == -1 || leftHeight != rightHeight) {
+			return -1;
+		}
+		return leftHeight + (node->color == 0 ? 1 : 0);
+	}
+
+	// as RBTree::validate: checks the tree after every change when
+	// RBTREE_VALIDATE is defined, and is empty otherwise
+	void validate() const {
+#ifdef RBTREE_VALIDATE
+		if (!isValid()) {
+			throw std::logic_error("PersistentRBTree invariant broken");
+		}
+#endif
+	}
+
+public:
+	PersistentRBTree() = default;
+
+	explicit PersistentRBTree(const Compare &compare) : comp(compare) {}
+
+	// A tree which starts out as a snapshot, sharing all of its
+	// nodes, and then goes its own way. O(1).
+	explicit PersistentRBTree(const Snapshot &from) : root(from.root), comp(from.comp), count(from.count) {
+		retain(root);
+	}
+
+	PersistentRBTree(const PersistentRBTree &) = delete;
+	PersistentRBTree &operator=(const PersistentRBTree &) = delete;
+
+	~PersistentRBTree() {
+		release(root);
+	}
+
+	// the tree as it is now, in O(1)
+	Snapshot snapshot() const {
+		return Snapshot(root, count, comp);
+	}
+
+	const Node *searchTree(const Key &k) const {
+		return find(root, k, comp);
+	}
+
+	bool contains(const Key &k) const {
+		return find(root, k, comp) != nullptr;
+	}
+
+	template <typename Visit>
+	void forEach(Visit visit) const {
+		inorder(root, visit);
+	}
+
+	const Node *getRoot() const {
+		return root;
+	}
+
+	void insert(const Key &key) {
+		int depth = 0;
+		for (Node *x = own(root); x != nullptr; depth++) {
+			path[depth] = x;
+			dir[depth] = comp(key, x->key) ? LEFT : RIGHT;
+			x = own(child(x, dir[depth]));
+		}
+
+		Node *node = new Node(key, 1, nullptr, nullptr); // new node must be red
+		count++;
+		if (depth == 0) {
+			root = node;
+			node->color = 0;
+		} else {
+			child(path[depth - 1], dir[depth - 1]) = node;
+			fixInsert(depth);
+		}
+		validate();
+	}
+
+	// returns false if key was not in the tree
+	bool deleteNode(const Key &key) {
+		// find the node without copying anything, so that a miss
+		// leaves nodes shared with snapshots alone
+		if (find(root, key, comp) == nullptr) {
+			return false;
+		}
+
+		int depth = 0;
+		Node *z = own(root);
+		while (comp(key, z->key) || comp(z->key, key)) {
+			path[depth] = z;
+			dir[depth] = comp(key, z->key) ? LEFT : RIGHT;
+			z = own(child(z, dir[depth]));
+			depth++;
+		}
+
+		// with two children, take the successor's key and remove
+		// the successor instead, which has no left child
+		Node *m = z;
+		if (z->left != nullptr && z->right != nullptr) {
+			path[depth] = z;
+			dir[depth] = RIGHT;
+			depth++;
+			m = own(z->right);
+			while (m->left != nullptr) {
+				path[depth] = m;
+				dir[depth] = LEFT;
+				depth++;
+				m = own(m->left);
+			}
+			z->key = m->key;
+		}
+
+		// m's link to its child moves to the node above, so m no
+		// longer holds anything when it is freed
+		Node *c = m->left != nullptr ? m->left : m->right;
+		relink(depth, c);
+		int removedColor = m->color;
+		m->left = m->right = nullptr;
+		release(m);
+		count--;
+
+		if (removedColor == 0) {
+			if (depth == 0) {
+				// removed the root; its child (if any) is the new root
+				if (root != nullptr) {
+					own(root)->color = 0;
+				}
+			} else {
+				fixDelete(depth - 1);
+			}
+		}
+		validate();
+		return true;
+	}
+
+	// checks BST order, no red node with a red child, a black
+	// root, and equal black heights on every path
+	bool isValid() const {
+		return !isRed(root) && checkSubtree(root, nullptr, nullptr) != -1;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return root == nullptr;
+	}
+
+	// nodes insert and deleteNode have copied because a snapshot
+	// still held them
+	size_t nodesCopied() const {
+		return copied;
+	}
+
+	size_t calculateMemoryUsage() const {
+		return count * sizeof(Node);
+	}
+};
+
+#endif
@@ -0,0 +1,1923 @@
+#ifndef RBTREE_HPP
+#define RBTREE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "node_pool.hpp"
+
+// Mapped type for trees used as plain sets of keys
+struct RBNoValue {};
+
+// The links and color every node has. The TNULL sentinel is just
+// one of these, with no key or value.
+struct RBNodeBase {
+	RBNodeBase *parent;
+	RBNodeBase *left;
+	RBNodeBase *right;
+	int color; // 1 -> Red, 0 -> Black
+};
+
+// The TNULL sentinel, shared by every RBTree so that nodes can move
+// between trees. Nothing ever writes to it, so trees in different
+// threads can all use it at once.
+inline RBNodeBase rbTreeNil = {nullptr, nullptr, nullptr, 0};
+
+// Number of nodes in the subtree under a node, kept only by
+// order-statistic trees. The empty version takes no space.
+template <bool Enabled>
+struct RBNodeSize {};
+
+template <>
+struct RBNodeSize<true> {
+	size_t size = 1;
+};
+
+template <typename Key, typename Value, bool OrderStats = false>
+struct RBNode : RBNodeBase, RBNodeSize<OrderStats> {
+	std::pair<const Key, Value> kv;
+
+	template <typename... Args>
+	RBNode(const RBNodeBase &links, Args &&...args) : RBNodeBase(links), kv(std::forward<Args>(args)...) {}
+};
+
+// File format written by RBTree::save: an RBFileHeader, then one
+// RBFileNode per element in key order, so node i holds the element
+// of rank i. Children are indices into that array. The layout is
+// the machine's own (byte order, padding), and it can be read in
+// place through mmap by MappedRBTree, or loaded back into an RBTree.
+static const char RB_FILE_MAGIC[8] = {'R', 'B', 'T', 'R', 'E', 'E', '\0', '\0'};
+static const uint32_t RB_FILE_VERSION = 1;
+static const uint32_t RB_FILE_NIL = UINT32_MAX; // no child, or no root
+
+struct RBFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t nodeSize; // sizeof(RBFileNode<Key, Value>), to catch other types
+	uint64_t count;
+	uint32_t root;
+	uint32_t keySize; // sizeof(Key)
+};
+
+// the value of a saved node; sets store none
+template <typename Value>
+struct RBFileValue {
+	Value value;
+};
+
+template <>
+struct RBFileValue<RBNoValue> {};
+
+template <typename Key, typename Value>
+struct RBFileNode : RBFileValue<Value> {
+	Key key;
+	uint32_t left;
+	uint32_t right;
+	uint8_t color; // 1 -> Red, 0 -> Black
+};
+
+// Per-instance operation counters. They only take space and time
+// when a tree asks for them with TrackStats = true.
+template <bool Enabled>
+class RBTreeStats {
+protected:
+	void countComparison() {}
+
+public:
+	unsigned long long comparisons() const {
+		return 0;
+	}
+
+	void resetStats() {}
+};
+
+template <>
+class RBTreeStats<true> {
+private:
+	unsigned long long comparisonCount = 0;
+
+protected:
+	void countComparison() {
+		comparisonCount++;
+	}
+
+public:
+	unsigned long long comparisons() const {
+		return comparisonCount;
+	}
+
+	void resetStats() {
+		comparisonCount = 0;
+	}
+};
+
+// Ordered map (or, with the default RBNoValue, ordered set) built
+// on a red-black tree with parent pointers and a TNULL sentinel.
+//
+// There are two interfaces over the same tree:
+//  - the original RBTree one (insert(key), searchTree, deleteNode,
+//    the traversals), where insert keeps every duplicate key, and
+//  - an std::map-like one (emplace, try_emplace, operator[], find,
+//    lower_bound, upper_bound, erase and bidirectional iterators)
+//    with unique keys, so the tree can stand in for std::map.
+// Nodes come from a NodePool, so destroying the tree is O(chunks)
+// when the key and value types are trivially destructible. All
+// trees share one read-only sentinel, so an empty tree allocates
+// nothing, and join, split and the set operations can move whole
+// subtrees from one tree to another.
+//
+// With OrderStats = true every node also keeps the size of its
+// subtree, which select, rank and countRange use to answer order
+// queries in O(log n). Every operation that relinks nodes keeps the
+// sizes right; trees without OrderStats neither store nor update them.
+template <typename Key, typename Value = RBNoValue, typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>, bool TrackStats = false,
+          bool OrderStats = false>
+class RBTree : public RBTreeStats<TrackStats> {
+public:
+	typedef Key key_type;
+	typedef Value mapped_type;
+	typedef std::pair<const Key, Value> value_type;
+	typedef Compare key_compare;
+	typedef Allocator allocator_type;
+	typedef size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef RBNode<Key, Value, OrderStats> Node;
+	typedef RBNodeBase *NodePtr;
+
+	template <bool Const>
+	class Iterator {
+	private:
+		friend class RBTree;
+		NodePtr node = nullptr;
+		const RBTree *tree = nullptr;
+
+		Iterator(NodePtr n, const RBTree *t) : node(n), tree(t) {}
+
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef typename RBTree::value_type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef typename std::conditional<Const, const value_type *, value_type *>::type pointer;
+		typedef typename std::conditional<Const, const value_type &, value_type &>::type reference;
+
+		Iterator() = default;
+
+		// iterator converts to const_iterator
+		template <bool WasConst, typename = typename std::enable_if<Const && !WasConst>::type>
+		Iterator(const Iterator<WasConst> &other) : node(other.node), tree(other.tree) {}
+
+		reference operator*() const {
+			return static_cast<Node *>(node)->kv;
+		}
+
+		pointer operator->() const {
+			return &static_cast<Node *>(node)->kv;
+		}
+
+		Iterator &operator++() {
+			node = tree->successor(node);
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator old = *this;
+			++*this;
+			return old;
+		}
+
+		Iterator &operator--() {
+			node = tree->predecessor(node);
+			return *this;
+		}
+
+		Iterator operator--(int) {
+			Iterator old = *this;
+			--*this;
+			return old;
+		}
+
+		template <bool OtherConst>
+		bool operator==(const Iterator<OtherConst> &other) const {
+			return node == other.node;
+		}
+
+		template <bool OtherConst>
+		bool operator!=(const Iterator<OtherConst> &other) const {
+			return node != other.node;
+		}
+
+		template <bool>
+		friend class Iterator;
+	};
+
+	typedef Iterator<false> iterator;
+	typedef Iterator<true> const_iterator;
+
+private:
+	static constexpr NodePtr TNULL = &rbTreeNil;
+	static constexpr size_t UNKNOWN_SIZE = size_t(-1);
+	static constexpr int LEFT = 0, RIGHT = 1;
+	// subtrees with fewer black levels than this are not worth a thread
+	static constexpr int PARALLEL_BLACK_HEIGHT = 8;
+	// A red-black tree of n nodes is at most 2 log2(n + 1) tall, so
+	// this bounds the explicit stacks below for any tree that fits
+	// in a 64-bit address space
+	static constexpr int MAX_HEIGHT = 128;
+	// lookups searchBatch keeps in flight at once
+	static constexpr size_t BATCH_LANES = 16;
+
+	NodePtr root = TNULL;
+	NodePool<Node, Allocator> pool; // owns every node
+	Compare comp;
+	mutable size_t nodeCount = 0; // UNKNOWN_SIZE after a split, until counted
+
+	static const Key &key(NodePtr node) {
+		return static_cast<Node *>(node)->kv.first;
+	}
+
+	bool equal(const Key &a, const Key &b) const {
+		return !comp(a, b) && !comp(b, a);
+	}
+
+	// nodes under node, or 0 without OrderStats
+	static size_t subtreeSize(NodePtr node) {
+		if constexpr (OrderStats) {
+			return node == TNULL ? 0 : static_cast<Node *>(node)->size;
+		} else {
+			return 0;
+		}
+	}
+
+	// recomputes node's subtree size after its children changed
+	static void update(NodePtr node) {
+		if constexpr (OrderStats) {
+			static_cast<Node *>(node)->size = subtreeSize(node->left) + subtreeSize(node->right) + 1;
+		}
+	}
+
+	template <typename... Args>
+	Node *createNode(Args &&...args) {
+		void *storage = pool.allocate();
+		try {
+			return new (storage) Node(RBNodeBase{nullptr, TNULL, TNULL, 1}, std::forward<Args>(args)...);
+		} catch (...) {
+			pool.deallocate(static_cast<Node *>(storage));
+			throw;
+		}
+	}
+
+	void destroyNode(NodePtr node) {
+		static_cast<Node *>(node)->~Node();
+		pool.deallocate(static_cast<Node *>(node));
+	}
+
+	// Visits every node under top in no particular order, using a
+	// fixed stack rather than recursion. Only child links are
+	// followed, so it works on detached subtrees whose parent links
+	// are stale, and visit may destroy the node it is given.
+	template <typename Visit>
+	static void forEachNode(NodePtr top, Visit visit) {
+		// each level leaves at most one node waiting, plus the two
+		// children of the node just popped
+		NodePtr stack[MAX_HEIGHT + 2];
+		int size = 0;
+		if (top != TNULL) {
+			stack[size++] = top;
+		}
+		while (size > 0) {
+			NodePtr node = stack[--size];
+			if (node->right != TNULL) {
+				stack[size++] = node->right;
+			}
+			if (node->left != TNULL) {
+				stack[size++] = node->left;
+			}
+			visit(node);
+		}
+	}
+
+	void destroySubtree(NodePtr node) {
+		forEachNode(node, [](NodePtr n) { static_cast<Node *>(n)->~Node(); });
+	}
+
+	// destroys and frees a detached subtree, returning its size
+	size_t freeSubtree(NodePtr node) {
+		size_t freed = 0;
+		forEachNode(node, [&](NodePtr n) {
+			destroyNode(n);
+			freed++;
+		});
+		return freed;
+	}
+
+	static size_t countSubtree(NodePtr node) {
+		size_t count = 0;
+		forEachNode(node, [&](NodePtr) { count++; });
+		return count;
+	}
+
+	// Black height of the subtree under node, or -1 if it breaks an
+	// invariant, in which case broken says which. Every key must lie
+	// in [*low, *high], where a null bound is open; the bounds are not
+	// strict because insert(key) keeps duplicates, and rotations can
+	// leave equal keys on either side of each other.
+	int checkSubtree(NodePtr node, const Key *low, const Key *high, int depth, size_t &count,
+	                 const char *&broken) const {
+		if (node == TNULL) {
+			return 0;
+		}
+		if (depth > MAX_HEIGHT) {
+			// also catches a cycle of child links
+			broken = "a path is too long for a balanced tree";
+			return -1;
+		}
+		count++;
+		const Key &k = key(node);
+		if ((low != nullptr && comp(k, *low)) || (high != nullptr && comp(*high, k))) {
+			broken = "keys are out of order";
+			return -1;
+		}
+		if ((node->left != TNULL && node->left->parent != node) ||
+		    (node->right != TNULL && node->right->parent != node)) {
+			broken = "a parent link does not match its child link";
+			return -1;
+		}
+		if (node->color != 0 && node->color != 1) {
+			broken = "a node is neither red nor black";
+			return -1;
+		}
+		if (node->color == 1 && (node->left->color == 1 || node->right->color == 1)) {
+			broken = "a red node has a red child";
+			return -1;
+		}
+		int leftHeight = checkSubtree(node->left, low, &k, depth + 1, count, broken);
+		if (leftHeight < 0) {
+			return -1;
+		}
+		int rightHeight = checkSubtree(node->right, &k, high, depth + 1, count, broken);
+		if (rightHeight < 0) {
+			return -1;
+		}
+		if (leftHeight != rightHeight) {
+			broken = "black heights differ";
+			return -1;
+		}
+		if constexpr (OrderStats) {
+			if (static_cast<Node *>(node)->size != subtreeSize(node->left) + subtreeSize(node->right) + 1) {
+				broken = "a subtree size is wrong";
+				return -1;
+			}
+		}
+		return leftHeight + (node->color == 0 ? 1 : 0);
+	}
+
+	// With RBTREE_VALIDATE defined, every operation that changes the
+	// tree ends here, and a broken invariant throws logic_error. In
+	// other builds this is empty and costs nothing.
+	void validate() const {
+#ifdef RBTREE_VALIDATE
+		if (const char *broken = checkInvariants()) {
+			throw std::logic_error(std::string("RBTree invariant broken: ") + broken);
+		}
+#endif
+	}
+
+	void adjustCount(int change) {
+		if (nodeCount != UNKNOWN_SIZE) {
+			nodeCount += change;
+		}
+	}
+
+	NodePtr clone(NodePtr node, NodePtr parent) {
+		if (node == TNULL) {
+			return TNULL;
+		}
+		Node *copy = createNode(static_cast<Node *>(node)->kv);
+		copy->color = node->color;
+		copy->parent = parent;
+		copy->left = clone(node->left, copy);
+		copy->right = clone(node->right, copy);
+		update(copy);
+		return copy;
+	}
+
+	// key of a bulk load item, which is either a key or a key-value pair
+	template <typename Item>
+	static const auto &itemKey(const Item &item) {
+		if constexpr (std::is_convertible<const Item &, const Key &>::value) {
+			return item;
+		} else {
+			return item.first;
+		}
+	}
+
+	template <typename Item>
+	Node *createFromItem(const Item &item) {
+		if constexpr (std::is_convertible<const Item &, const Key &>::value) {
+			return createNode(std::piecewise_construct, std::forward_as_tuple(item), std::tuple<>());
+		} else {
+			return createNode(item);
+		}
+	}
+
+	// Links the next n items into a balanced subtree, allocating
+	// the nodes in key order. Nodes on the deepest level, redDepth,
+	// are red and the rest are black: every leaf is on that level
+	// or the one above, so each path sees the same number of blacks.
+	template <typename ForwardIt>
+	NodePtr buildSubtree(ForwardIt &next, size_t n, int depth, int redDepth) {
+		if (n == 0) {
+			return TNULL;
+		}
+		size_t leftCount = (n - 1) / 2;
+		NodePtr left = buildSubtree(next, leftCount, depth + 1, redDepth);
+		Node *node = createFromItem(*next);
+		++next;
+		NodePtr right = buildSubtree(next, n - 1 - leftCount, depth + 1, redDepth);
+
+		node->left = left;
+		node->right = right;
+		if (left != TNULL) {
+			left->parent = node;
+		}
+		if (right != TNULL) {
+			right->parent = node;
+		}
+		update(node);
+		node->color = (depth == redDepth && depth > 0) ? 1 : 0;
+		return node;
+	}
+
+	////////////////////////////////////////////////////////////
+	// Join and split on detached subtrees
+	////////////////////////////////////////////////////////////
+	// These never look at the parent link of the subtrees they are
+	// given, and leave the parent of the subtree they return for the
+	// caller to set. They write to no node outside the subtrees
+	// involved, so disjoint subtrees can be worked on in parallel.
+
+	// black nodes on every path from node down to TNULL
+	static int blackHeight(NodePtr node) {
+		int height = 0;
+		for (; node != TNULL; node = node->left) {
+			if (node->color == 0) {
+				height++;
+			}
+		}
+		return height;
+	}
+
+	static NodePtr &child(NodePtr node, int d) {
+		return d == LEFT ? node->left : node->right;
+	}
+
+	static void setChildren(NodePtr node, NodePtr left, NodePtr right) {
+		node->left = left;
+		node->right = right;
+		if (left != TNULL) {
+			left->parent = node;
+		}
+		if (right != TNULL) {
+			right->parent = node;
+		}
+		update(node);
+	}
+
+	// rotates x down toward side d, returning the child which took
+	// its place (whose parent the caller sets)
+	static NodePtr rotateSubtree(NodePtr x, int d) {
+		NodePtr y = child(x, !d);
+		child(x, !d) = child(y, d);
+		if (child(y, d) != TNULL) {
+			child(y, d)->parent = x;
+		}
+		child(y, d) = x;
+		x->parent = y;
+		update(x);
+		update(y);
+		return y;
+	}
+
+	// Hangs k and the shorter tree off the side d spine of the taller
+	// one, at the first black node whose black height matches. The
+	// only red-red pair this can make is fixed by a rotation on the
+	// way back up, or by blackening the root in joinSubtrees.
+	static NodePtr joinSpine(NodePtr tall, int tallHeight, NodePtr k, NodePtr shorter, int shortHeight, int d) {
+		if (tall->color == 0 && tallHeight == shortHeight) {
+			if (d == RIGHT) {
+				setChildren(k, tall, shorter);
+			} else {
+				setChildren(k, shorter, tall);
+			}
+			k->color = 1;
+			return k;
+		}
+
+		NodePtr below = joinSpine(child(tall, d), tallHeight - (tall->color == 0 ? 1 : 0), k, shorter, shortHeight, d);
+		child(tall, d) = below;
+		below->parent = tall;
+		update(tall);
+		if (tall->color == 0 && below->color == 1 && child(below, d)->color == 1) {
+			child(below, d)->color = 0;
+			return rotateSubtree(tall, !d);
+		}
+		return tall;
+	}
+
+	// joins left < k < right into one valid subtree in
+	// O(log n), where every key of left and right is on that side of k
+	static NodePtr joinSubtrees(NodePtr left, NodePtr k, NodePtr right) {
+		// a red root can always be made black, and then both sides
+		// are black-rooted trees of known black height
+		if (left->color == 1) {
+			left->color = 0;
+		}
+		if (right->color == 1) {
+			right->color = 0;
+		}
+		int leftHeight = blackHeight(left), rightHeight = blackHeight(right);
+
+		NodePtr out;
+		if (leftHeight > rightHeight) {
+			out = joinSpine(left, leftHeight, k, right, rightHeight, RIGHT);
+		} else if (rightHeight > leftHeight) {
+			out = joinSpine(right, rightHeight, k, left, leftHeight, LEFT);
+		} else {
+			setChildren(k, left, right);
+			k->color = 1;
+			out = k;
+		}
+		if (out->color == 1 && (out->left->color == 1 || out->right->color == 1)) {
+			out->color = 0;
+		}
+		return out;
+	}
+
+	// removes the largest node of a non-empty subtree, returning it
+	static NodePtr splitLast(NodePtr node, NodePtr &rest) {
+		if (node->right == TNULL) {
+			rest = node->left;
+			return node;
+		}
+		NodePtr right;
+		NodePtr last = splitLast(node->right, right);
+		rest = joinSubtrees(node->left, node, right);
+		return last;
+	}
+
+	// joins left < right with no key in between
+	static NodePtr joinSubtrees(NodePtr left, NodePtr right) {
+		if (left == TNULL) {
+			return right;
+		}
+		NodePtr rest;
+		NodePtr last = splitLast(left, rest);
+		return joinSubtrees(rest, last, right);
+	}
+
+	// Splits a subtree into the keys less than k, the node with key
+	// k (or TNULL) and the keys greater than k. Assumes unique keys.
+	void splitSubtree(NodePtr node, const Key &k, NodePtr &less, NodePtr &match, NodePtr &greater) const {
+		if (node == TNULL) {
+			less = match = greater = TNULL;
+			return;
+		}
+		NodePtr left = node->left, right = node->right, rest;
+		if (comp(k, key(node))) {
+			splitSubtree(left, k, less, match, rest);
+			greater = joinSubtrees(rest, node, right);
+		} else if (comp(key(node), k)) {
+			splitSubtree(right, k, rest, match, greater);
+			less = joinSubtrees(left, node, rest);
+		} else {
+			less = left;
+			greater = right;
+			match = node;
+			match->left = match->right = TNULL;
+			update(match);
+		}
+	}
+
+	// Splits a subtree into the keys less than k and the rest, which
+	// also works with duplicate keys
+	void splitBefore(NodePtr node, const Key &k, NodePtr &less, NodePtr &rest) const {
+		if (node == TNULL) {
+			less = rest = TNULL;
+			return;
+		}
+		NodePtr left = node->left, right = node->right, middle;
+		if (comp(key(node), k)) {
+			splitBefore(right, k, middle, rest);
+			less = joinSubtrees(left, node, middle);
+		} else {
+			splitBefore(left, k, less, middle);
+			rest = joinSubtrees(middle, node, right);
+		}
+	}
+
+	////////////////////////////////////////////////////////////
+	// Fork-join set operations on detached subtrees
+	////////////////////////////////////////////////////////////
+	// a holds this tree's nodes and b the other tree's. Nodes which
+	// drop out are detached and pushed onto garbage, since the pool
+	// can only be touched by one thread; the caller frees them.
+
+	// forks levels of recursion hand their first half to a new thread
+	static int forkLevels(unsigned threads) {
+		if (threads == 0) {
+			threads = std::thread::hardware_concurrency();
+		}
+		int levels = 0;
+		while ((1u << levels) < threads) {
+			levels++;
+		}
+		// one more level than strictly needed evens out uneven halves
+		return threads > 1 ? levels + 1 : 0;
+	}
+
+	template <typename First, typename Second>
+	static void forkJoin(int forks, NodePtr a, NodePtr b, First first, Second second, std::vector<NodePtr> &garbage) {
+		if (forks > 0 && std::max(blackHeight(a), blackHeight(b)) >= PARALLEL_BLACK_HEIGHT) {
+			std::vector<NodePtr> firstGarbage;
+			auto task = std::async(std::launch::async, [&] { first(forks - 1, firstGarbage); });
+			second(forks - 1, garbage);
+			task.get();
+			garbage.insert(garbage.end(), firstGarbage.begin(), firstGarbage.end());
+		} else {
+			first(forks, garbage);
+			second(forks, garbage);
+		}
+	}
+
+	NodePtr unionOf(NodePtr a, NodePtr b, int forks, std::vector<NodePtr> &garbage) const {
+		if (a == TNULL) {
+			return b;
+		}
+		if (b == TNULL) {
+			return a;
+		}
+		NodePtr bLeft = b->left, bRight = b->right, less, match, greater, left, right;
+		splitSubtree(a, key(b), less, match, greater);
+		forkJoin(forks, a, b,
+		         [&](int f, std::vector<NodePtr> &g) { left = unionOf(less, bLeft, f, g); },
+		         [&](int f, std::vector<NodePtr> &g) { right = unionOf(greater, bRight, f, g); }, garbage);
+		if (match == TNULL) {
+			return joinSubtrees(left, b, right);
+		}
+		// keep this tree's element
+		b->left = b->right = TNULL;
+		garbage.push_back(b);
+		return joinSubtrees(left, match, right);
+	}
+
+	NodePtr intersectionOf(NodePtr a, NodePtr b, int forks, std::vector<NodePtr> &garbage) const {
+		if (a == TNULL || b == TNULL) {
+			garbage.push_back(a == TNULL ? b : a);
+			return TNULL;
+		}
+		NodePtr bLeft = b->left, bRight = b->right, less, match, greater, left, right;
+		splitSubtree(a, key(b), less, match, greater);
+		forkJoin(forks, a, b,
+		         [&](int f, std::vector<NodePtr> &g) { left = intersectionOf(less, bLeft, f, g); },
+		         [&](int f, std::vector<NodePtr> &g) { right = intersectionOf(greater, bRight, f, g); }, garbage);
+		b->left = b->right = TNULL;
+		garbage.push_back(b);
+		if (match == TNULL) {
+			return joinSubtrees(left, right);
+		}
+		return joinSubtrees(left, match, right);
+	}
+
+	NodePtr differenceOf(NodePtr a, NodePtr b, int forks, std::vector<NodePtr> &garbage) const {
+		if (a == TNULL || b == TNULL) {
+			garbage.push_back(b);
+			return a;
+		}
+		NodePtr bLeft = b->left, bRight = b->right, less, match, greater, left, right;
+		splitSubtree(a, key(b), less, match, greater);
+		forkJoin(forks, a, b,
+		         [&](int f, std::vector<NodePtr> &g) { left = differenceOf(less, bLeft, f, g); },
+		         [&](int f, std::vector<NodePtr> &g) { right = differenceOf(greater, bRight, f, g); }, garbage);
+		b->left = b->right = TNULL;
+		garbage.push_back(b);
+		if (match != TNULL) {
+			garbage.push_back(match);
+		}
+		return joinSubtrees(left, right);
+	}
+
+	typedef NodePtr (RBTree::*SetOperation)(NodePtr, NodePtr, int, std::vector<NodePtr> &) const;
+
+	// takes over other's nodes and memory, and combines the trees
+	void combine(RBTree &&other, unsigned threads, SetOperation operation) {
+		size_t total = size() + other.size();
+		NodePtr b = other.root;
+		pool.adopt(std::move(other.pool));
+		other.root = TNULL;
+		other.nodeCount = 0;
+
+		std::vector<NodePtr> garbage;
+		root = (this->*operation)(root, b, forkLevels(threads), garbage);
+		setRoot(root);
+		for (NodePtr dropped : garbage) {
+			total -= freeSubtree(dropped);
+		}
+		nodeCount = total;
+		validate();
+	}
+
+	void setRoot(NodePtr node) {
+		root = node;
+		if (root != TNULL) {
+			root->parent = nullptr;
+			root->color = 0;
+		}
+	}
+
+	NodePtr successor(NodePtr node) const {
+		if (node->right != TNULL) {
+			return minimum(node->right);
+		}
+		NodePtr p = node->parent;
+		while (p != nullptr && node == p->right) {
+			node = p;
+			p = p->parent;
+		}
+		return p == nullptr ? TNULL : p;
+	}
+
+	// the predecessor of end() is the maximum
+	NodePtr predecessor(NodePtr node) const {
+		if (node == TNULL) {
+			return maximum(root);
+		}
+		if (node->left != TNULL) {
+			return maximum(node->left);
+		}
+		NodePtr p = node->parent;
+		while (p != nullptr && node == p->left) {
+			node = p;
+			p = p->parent;
+		}
+		return p == nullptr ? TNULL : p;
+	}
+
+	// The traversals below climb back up through parent links
+	// instead of keeping a stack, so they need O(1) space and work
+	// on any tree height.
+
+	// visit(node, depth) for the whole tree, node before children
+	template <typename Visit>
+	void preOrder(Visit visit) const {
+		NodePtr node = root;
+		int depth = 0;
+		while (node != TNULL) {
+			visit(node, depth);
+			if (node->left != TNULL) {
+				node = node->left;
+				depth++;
+			} else if (node->right != TNULL) {
+				node = node->right;
+				depth++;
+			} else {
+				// back up to the nearest left child whose sibling is
+				// still to be visited
+				while (node->parent != nullptr && (node == node->parent->right || node->parent->right == TNULL)) {
+					node = node->parent;
+					depth--;
+				}
+				node = node->parent == nullptr ? TNULL : node->parent->right;
+			}
+		}
+	}
+
+	// visit(node) for the whole tree, children before node
+	template <typename Visit>
+	void postOrder(Visit visit) const {
+		NodePtr node = root == TNULL ? TNULL : deepestFirst(root);
+		while (node != TNULL) {
+			NodePtr p = node->parent;
+			NodePtr next;
+			if (p == nullptr) {
+				next = TNULL;
+			} else if (node == p->left && p->right != TNULL) {
+				next = deepestFirst(p->right);
+			} else {
+				next = p;
+			}
+			visit(node);
+			node = next;
+		}
+	}
+
+	// the first node of node's subtree in postorder
+	static NodePtr deepestFirst(NodePtr node) {
+		while (true) {
+			if (node->left != TNULL) {
+				node = node->left;
+			} else if (node->right != TNULL) {
+				node = node->right;
+			} else {
+				return node;
+			}
+		}
+	}
+
+	NodePtr searchTree(NodePtr node, const Key &k) {
+		while (node != TNULL && !equal(k, key(node))) {
+			this->countComparison();
+			node = comp(k, key(node)) ? node->left : node->right;
+		}
+		return node;
+	}
+
+	// fix the rb tree modified by the delete operation. x may be
+	// TNULL, which has no parent of its own, so xParent is passed in.
+	void fixDelete(NodePtr x, NodePtr xParent) {
+		NodePtr s;
+		while (x != root && x->color == 0) {
+			if (x == xParent->left) {
+				s = xParent->right;
+				if (s->color == 1) {
+					// case 3.1
+					s->color = 0;
+					xParent->color = 1;
+					leftRotate(xParent);
+					s = xParent->right;
+				}
+
+				if (s->left->color == 0 && s->right->color == 0) {
+					// case 3.2
+					s->color = 1;
+					x = xParent;
+					xParent = x->parent;
+				} else {
+					if (s->right->color == 0) {
+						// case 3.3
+						s->left->color = 0;
+						s->color = 1;
+						rightRotate(s);
+						s = xParent->right;
+					}
+
+					// case 3.4
+					s->color = xParent->color;
+					xParent->color = 0;
+					s->right->color = 0;
+					leftRotate(xParent);
+					x = root;
+				}
+			} else {
+				s = xParent->left;
+				if (s->color == 1) {
+					// case 3.1
+					s->color = 0;
+					xParent->color = 1;
+					rightRotate(xParent);
+					s = xParent->left;
+				}
+
+				if (s->left->color == 0 && s->right->color == 0) {
+					// case 3.2
+					s->color = 1;
+					x = xParent;
+					xParent = x->parent;
+				} else {
+					if (s->left->color == 0) {
+						// case 3.3
+						s->right->color = 0;
+						s->color = 1;
+						leftRotate(s);
+						s = xParent->left;
+					}
+
+					// case 3.4
+					s->color = xParent->color;
+					xParent->color = 0;
+					s->left->color = 0;
+					rightRotate(xParent);
+					x = root;
+				}
+			}
+		}
+		if (x != TNULL) {
+			x->color = 0;
+		}
+	}
+
+	void rbTransplant(NodePtr u, NodePtr v){
+		if (u->parent == nullptr) {
+			root = v;
+		} else if (u == u->parent->left){
+			u->parent->left = v;
+		} else {
+			u->parent->right = v;
+		}
+		if (v != TNULL) {
+			v->parent = u->parent;
+		}
+	}
+
+	// unlink z from the tree, free it and rebalance
+	void eraseNode(NodePtr z) {
+		NodePtr x, y, xParent;
+		y = z;
+		int y_original_color = y->color;
+		if (z->left == TNULL) {
+			x = z->right;
+			xParent = z->parent;
+			rbTransplant(z, z->right);
+		} else if (z->right == TNULL) {
+			x = z->left;
+			xParent = z->parent;
+			rbTransplant(z, z->left);
+		} else {
+			y = minimum(z->right);
+			y_original_color = y->color;
+			x = y->right;
+			if (y->parent == z) {
+				xParent = y;
+			} else {
+				xParent = y->parent;
+				rbTransplant(y, y->right);
+				y->right = z->right;
+				y->right->parent = y;
+			}
+
+			rbTransplant(z, y);
+			y->left = z->left;
+			y->left->parent = y;
+			y->color = z->color;
+		}
+		destroyNode(z);
+		adjustCount(-1);
+		// every subtree that lost a node is on the path up from xParent
+		for (NodePtr p = xParent; OrderStats && p != nullptr; p = p->parent) {
+			update(p);
+		}
+		if (y_original_color == 0){
+			fixDelete(x, xParent);
+		}
+		validate();
+	}
+
+	bool deleteNode(NodePtr node, const Key &k) {
+		// find the node containing key
+		NodePtr z = TNULL;
+		while (node != TNULL){
+			if (equal(key(node), k)) {
+				z = node;
+			}
+
+			if (!comp(k, key(node))) {
+				node = node->right;
+			} else {
+				node = node->left;
+			}
+			this->countComparison();
+		}
+
+		if (z == TNULL) {
+			return false;
+		}
+
+		eraseNode(z);
+		return true;
+	}
+
+	// fix the red-black tree
+	void fixInsert(NodePtr k){
+		NodePtr u;
+		while (k->parent->color == 1) {
+			if (k->parent == k->parent->parent->right) {
+				u = k->parent->parent->left; // uncle
+				if (u->color == 1) {
+					// case 3.1
+					u->color = 0;
+					k->parent->color = 0;
+					k->parent->parent->color = 1;
+					k = k->parent->parent;
+				} else {
+					if (k == k->parent->left) {
+						// case 3.2.2
+						k = k->parent;
+						rightRotate(k);
+					}
+					// case 3.2.1
+					k->parent->color = 0;
+					k->parent->parent->color = 1;
+					leftRotate(k->parent->parent);
+				}
+			} else {
+				u = k->parent->parent->right; // uncle
+
+				if (u->color == 1) {
+					// mirror case 3.1
+					u->color = 0;
+					k->parent->color = 0;
+					k->parent->parent->color = 1;
+					k = k->parent->parent;
+				} else {
+					if (k == k->parent->right) {
+						// mirror case 3.2.2
+						k = k->parent;
+						leftRotate(k);
+					}
+					// mirror case 3.2.1
+					k->parent->color = 0;
+					k->parent->parent->color = 1;
+					rightRotate(k->parent->parent);
+				}
+			}
+			if (k == root) {
+				break;
+			}
+		}
+		root->color = 0;
+	}
+
+	// hang a new node under y (or make it the root) and rebalance
+	void attachNode(NodePtr node, NodePtr y, bool asLeft) {
+		node->parent = y;
+		if (y == nullptr) {
+			root = node;
+		} else if (asLeft) {
+			y->left = node;
+		} else {
+			y->right = node;
+		}
+		adjustCount(1);
+		if constexpr (OrderStats) {
+			for (NodePtr p = y; p != nullptr; p = p->parent) {
+				static_cast<Node *>(p)->size++;
+			}
+		}
+
+		if (node->parent == nullptr){
+			// a new root node is just painted black
+			node->color = 0;
+		} else if (node->parent->parent != nullptr) {
+			// under a child of the root; a red node under the
+			// black root needs no fixing
+			fixInsert(node);
+		}
+		validate();
+	}
+
+	// where a unique key would go: returns the equal node if there
+	// is one, otherwise TNULL with parent and side filled in
+	NodePtr findSlot(const Key &k, NodePtr &parent, bool &asLeft) {
+		NodePtr x = root;
+		parent = nullptr;
+		asLeft = true;
+		while (x != TNULL) {
+			this->countComparison();
+			parent = x;
+			if (comp(k, key(x))) {
+				x = x->left;
+				asLeft = true;
+			} else if (comp(key(x), k)) {
+				x = x->right;
+				asLeft = false;
+			} else {
+				return x;
+			}
+		}
+		return TNULL;
+	}
+
+	void print() const {
+		// one indent string for the whole walk: a node at depth d
+		// shares its first 5 * d characters with the node printed
+		// just before it, so only the tail is rewritten
+		std::string indent;
+		preOrder([&](NodePtr node, int depth) {
+			bool last = node->parent == nullptr || node == node->parent->right;
+			indent.resize(5 * depth);
+			std::cout<<indent<<(last ? "R----" : "L----");
+			std::cout<<key(node)<<"("<<(node->color ? "RED" : "BLACK")<<")"<<std::endl;
+			indent += last ? "     " : "|    ";
+		});
+	}
+
+public:
+	RBTree() = default;
+
+	explicit RBTree(const Compare &compare, const Allocator &allocator = Allocator())
+	    : pool(allocator), comp(compare) {}
+
+	RBTree(const RBTree &other) : comp(other.comp) {
+		root = clone(other.root, nullptr);
+		nodeCount = other.size();
+	}
+
+	RBTree(RBTree &&other) noexcept
+	    : root(other.root), pool(std::move(other.pool)), comp(other.comp), nodeCount(other.nodeCount) {
+		other.root = TNULL;
+		other.nodeCount = 0;
+	}
+
+	RBTree &operator=(RBTree other) noexcept {
+		swap(other);
+		return *this;
+	}
+
+	~RBTree() {
+		clear();
+	}
+
+	void swap(RBTree &other) noexcept {
+		std::swap(root, other.root);
+		pool.swap(other.pool);
+		std::swap(comp, other.comp);
+		std::swap(nodeCount, other.nodeCount);
+	}
+
+	////////////////////////////////////////////////////////////
+	// Original RBTree interface
+	////////////////////////////////////////////////////////////
+
+	// Pre-Order traversal
+	// Node->Left->Right
+	void preorder() {
+		preOrder([](NodePtr node, int) { std::cout<<key(node)<<" "; });
+	}
+
+	// In-Order traversal
+	// Left->Node->Right
+	void inorder() {
+		for (NodePtr node = begin().node; node != TNULL; node = successor(node)) {
+			std::cout<<key(node)<<" ";
+		}
+	}
+
+	// Post-Order traversal
+	// Left->Right->Node
+	void postorder() {
+		postOrder([](NodePtr node) { std::cout<<key(node)<<" "; });
+	}
+
+	// Search for value k; nullptr if it is not in the tree
+	Node *searchTree(const Key &k) {
+		NodePtr found = searchTree(this->root, k);
+		return found == TNULL ? nullptr : static_cast<Node *>(found);
+	}
+
+	// Looks up keys[0..n), storing each one's node (or nullptr) in
+	// results. BATCH_LANES lookups are in flight at once: each round
+	// moves every one of them down a level and prefetches the node
+	// it will look at next, so the cache misses of different lookups
+	// overlap instead of being waited on one after another.
+	void searchBatch(const Key *keys, size_t n, Node **results) {
+		NodePtr lanes[BATCH_LANES]; // nullptr once a lane's lookup is done
+		for (size_t start = 0; start < n; start += BATCH_LANES) {
+			size_t width = std::min<size_t>(BATCH_LANES, n - start);
+			for (size_t i = 0; i < width; i++) {
+				lanes[i] = root;
+			}
+			for (size_t active = width; active > 0;) {
+				active = 0;
+				for (size_t i = 0; i < width; i++) {
+					NodePtr node = lanes[i];
+					if (node == nullptr) {
+						continue;
+					}
+					const Key &k = keys[start + i];
+					if (node == TNULL || equal(k, key(node))) {
+						results[start + i] = node == TNULL ? nullptr : static_cast<Node *>(node);
+						lanes[i] = nullptr;
+						continue;
+					}
+					this->countComparison();
+					node = comp(k, key(node)) ? node->left : node->right;
+					__builtin_prefetch(node);
+					lanes[i] = node;
+					active++;
+				}
+			}
+		}
+	}
+
+	// searchBatch for keys in ascending order. Each lookup starts at
+	// the node the previous one ended on and climbs only until the
+	// subtree there must hold the key, so neighbouring keys share the
+	// top of their paths rather than each walking down from the root.
+	// Keys out of order are still found, by starting from the root.
+	void searchSortedBatch(const Key *keys, size_t n, Node **results) {
+		NodePtr last = TNULL; // the last node a lookup looked at
+		for (size_t i = 0; i < n; i++) {
+			const Key &k = keys[i];
+			NodePtr node = root;
+			if (last != TNULL && !comp(k, key(last))) {
+				// every key between last and k is under node once
+				// node is a left child of a parent greater than k
+				node = last;
+				while (node->parent != nullptr && !equal(k, key(node)) &&
+				       !(node == node->parent->left && comp(k, key(node->parent)))) {
+					this->countComparison();
+					node = node->parent;
+				}
+			}
+			results[i] = nullptr;
+			while (node != TNULL) {
+				last = node;
+				if (equal(k, key(node))) {
+					results[i] = static_cast<Node *>(node);
+					break;
+				}
+				this->countComparison();
+				node = comp(k, key(node)) ? node->left : node->right;
+			}
+		}
+	}
+
+	// Calls visit(element) for every element with low <= key < high,
+	// in key order. Steps through successor links, so a scan costs
+	// O(log n + elements visited) with no recursion or allocation.
+	template <typename Visit>
+	void rangeScan(const Key &low, const Key &high, Visit visit) {
+		for (NodePtr node = lower_bound(low).node; node != TNULL && comp(key(node), high); node = successor(node)) {
+			visit(static_cast<Node *>(node)->kv);
+		}
+	}
+
+	template <typename Visit>
+	void rangeScan(const Key &low, const Key &high, Visit visit) const {
+		for (NodePtr node = lower_bound(low).node; node != TNULL && comp(key(node), high); node = successor(node)) {
+			visit(static_cast<const Node *>(node)->kv);
+		}
+	}
+
+	// return node with min value
+	NodePtr minimum(NodePtr node) const {
+		while (node->left != TNULL) {
+			node = node->left;
+		}
+		return node;
+	}
+
+	// return node with max value
+	NodePtr maximum(NodePtr node) const {
+		while (node->right != TNULL) {
+			node = node->right;
+		}
+		return node;
+	}
+
+	// rotate left at node x
+	void leftRotate(NodePtr x) {
+		NodePtr y = x->right;
+		x->right = y->left;
+		if (y->left != TNULL) {
+			y->left->parent = x;
+		}
+		y->parent = x->parent;
+		if (x->parent == nullptr) {
+			this->root = y;
+		} else if (x == x->parent->left) {
+			x->parent->left = y;
+		} else {
+			x->parent->right = y;
+		}
+		y->left = x;
+		x->parent = y;
+		update(x);
+		update(y);
+	}
+
+	// rotate right at node x
+	void rightRotate(NodePtr x) {
+		NodePtr y = x->left;
+		x->left = y->right;
+		if (y->right != TNULL) {
+			y->right->parent = x;
+		}
+		y->parent = x->parent;
+		if (x->parent == nullptr) {
+			this->root = y;
+		} else if (x == x->parent->right) {
+			x->parent->right = y;
+		} else {
+			x->parent->left = y;
+		}
+		y->right = x;
+		x->parent = y;
+		update(x);
+		update(y);
+	}
+
+	// insert the key to the tree in its appropriate position then
+	// fix the tree. Equal keys are all kept, newest to the right.
+	void insert(const Key &k) {
+		// Ordinary Binary Search Insertion
+		Node *node = createNode(std::piecewise_construct, std::forward_as_tuple(k), std::tuple<>());
+
+		NodePtr y = nullptr;
+		NodePtr x = this->root;
+
+		while (x != TNULL) {
+			y = x;
+			if (comp(k, key(x))) {
+				x = x->left;
+			} else {
+				x = x->right;
+			}
+			this->countComparison();
+		}
+
+		attachNode(node, y, y != nullptr && comp(k, key(y)));
+	}
+
+	NodePtr getRoot(){
+		return this->root;
+	}
+
+	// delete the node from the tree; false if the key was not found
+	bool deleteNode(const Key &data) {
+		return deleteNode(this->root, data);
+	}
+
+	// print the tree structure
+	void prettyPrint() {
+		print();
+	}
+
+	size_t calculateMemoryUsage(){
+		return size() * sizeof(Node);
+	}
+
+	// bytes the node pool has reserved, including free slots
+	size_t reservedBytes() const {
+		return pool.reservedBytes();
+	}
+
+	size_t chunkCount() const {
+		return pool.chunkCount();
+	}
+
+	////////////////////////////////////////////////////////////
+	// Bulk loading
+	////////////////////////////////////////////////////////////
+
+	// Replaces the contents with [first, last), which must already
+	// be sorted by key. Items are keys or key-value pairs. The tree
+	// is built bottom-up in O(n) with no comparisons or rotations,
+	// and its nodes sit in one block in key order. Equal keys are
+	// all kept, as with insert(key).
+	template <typename ForwardIt>
+	void bulkLoadSorted(ForwardIt first, ForwardIt last) {
+		clear();
+		size_t n = std::distance(first, last);
+		if (n == 0) {
+			return;
+		}
+
+		int deepest = 0; // floor(log2(n)), the depth of the last level
+		while ((size_t(2) << deepest) <= n) {
+			deepest++;
+		}
+
+		pool.reserve(n);
+		root = buildSubtree(first, n, 0, deepest);
+		root->parent = nullptr;
+		nodeCount = n;
+		validate();
+	}
+
+	// As bulkLoadSorted, but sorts a copy of the input first unless
+	// it is already in order
+	template <typename InputIt>
+	void bulkLoad(InputIt first, InputIt last) {
+		typedef typename std::iterator_traits<InputIt>::value_type Item;
+		std::vector<Item> items(first, last);
+		auto byKey = [this](const Item &a, const Item &b) {
+			return comp(itemKey(a), itemKey(b));
+		};
+		if (!std::is_sorted(items.begin(), items.end(), byKey)) {
+			std::stable_sort(items.begin(), items.end(), byKey);
+		}
+		bulkLoadSorted(items.begin(), items.end());
+	}
+
+	////////////////////////////////////////////////////////////
+	// Saving and loading
+	////////////////////////////////////////////////////////////
+
+	// Writes the tree in the RBTREE file format. Keys and values must
+	// be trivially copyable, since they are written as raw bytes.
+	// The nodes are numbered by one in-order walk and written with
+	// a single write, so saving is O(n).
+	void save(std::ostream &out) const {
+		static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+		              "RBTree::save writes keys and values as raw bytes");
+		typedef RBFileNode<Key, Value> FileNode;
+		size_t n = size();
+		if (n >= RB_FILE_NIL) {
+			throw std::length_error("RBTree::save: too many elements for 32-bit links");
+		}
+		RBFileHeader header;
+		std::memcpy(header.magic, RB_FILE_MAGIC, sizeof(header.magic));
+		header.version = RB_FILE_VERSION;
+		header.nodeSize = sizeof(FileNode);
+		header.count = n;
+		header.root = RB_FILE_NIL;
+		header.keySize = sizeof(Key);
+
+		// An in-order walk with an explicit stack. A node's left child
+		// is numbered before it, while the node is still on the stack,
+		// and its right child after it, so each link is filled in by
+		// whichever of the two is numbered second.
+		struct Frame {
+			NodePtr node;
+			uint32_t left;    // index of the node's left child
+			uint32_t rightOf; // index of the parent, if node is a right child
+		};
+		Frame stack[MAX_HEIGHT + 1];
+		int depth = 0;
+		std::vector<FileNode> nodes(n);
+		uint32_t next = 0, rightOf = RB_FILE_NIL;
+		for (NodePtr node = root; node != TNULL || depth > 0;) {
+			if (node != TNULL) {
+				stack[depth++] = Frame{node, RB_FILE_NIL, rightOf};
+				rightOf = RB_FILE_NIL;
+				node = node->left;
+				continue;
+			}
+			Frame frame = stack[--depth];
+			uint32_t i = next++;
+			FileNode &saved = nodes[i];
+			if constexpr (!std::is_same<Value, RBNoValue>::value) {
+				saved.value = static_cast<Node *>(frame.node)->kv.second;
+			}
+			saved.key = key(frame.node);
+			saved.left = frame.left;
+			saved.right = RB_FILE_NIL;
+			saved.color = frame.node->color;
+			if (frame.rightOf != RB_FILE_NIL) {
+				nodes[frame.rightOf].right = i;
+			} else if (depth > 0) {
+				stack[depth - 1].left = i; // a left child sits just above its parent
+			} else {
+				header.root = i;
+			}
+			node = frame.node->right;
+			rightOf = i;
+		}
+
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(nodes.data()), n * sizeof(FileNode));
+		if (!out) {
+			throw std::runtime_error("RBTree::save: write failed");
+		}
+	}
+
+	// Replaces the contents with a tree written by save. The saved
+	// shape and colors are kept, so loading makes one pass over the
+	// nodes with no comparisons or rebalancing, and the new nodes sit
+	// in one block in key order. Throws runtime_error if the data is
+	// not an RBTREE file for this Key and Value, or is damaged.
+	void load(std::istream &in) {
+		static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+		              "RBTree::load reads keys and values as raw bytes");
+		typedef RBFileNode<Key, Value> FileNode;
+		RBFileHeader header;
+		if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		    std::memcmp(header.magic, RB_FILE_MAGIC, sizeof(header.magic)) != 0) {
+			throw std::runtime_error("RBTree::load: not an RBTREE file");
+		}
+		if (header.version != RB_FILE_VERSION || header.nodeSize != sizeof(FileNode) ||
+		    header.keySize != sizeof(Key) || header.count >= RB_FILE_NIL) {
+			throw std::runtime_error("RBTree::load: saved with another version, key or value type");
+		}
+		// Read a bounded chunk at a time, so a damaged count runs out
+		// of data instead of asking for one huge allocation up front
+		const size_t CHUNK = 65536;
+		size_t n = header.count;
+		std::vector<FileNode> saved;
+		for (size_t done = 0; done < n;) {
+			size_t more = std::min(n - done, CHUNK);
+			saved.resize(done + more);
+			if (!in.read(reinterpret_cast<char *>(saved.data() + done), more * sizeof(FileNode))) {
+				throw std::runtime_error("RBTree::load: file is truncated");
+			}
+			done += more;
+		}
+
+		clear();
+		pool.reserve(n);
+		std::vector<NodePtr> nodes(n);
+		for (size_t i = 0; i < n; i++) {
+			if constexpr (std::is_same<Value, RBNoValue>::value) {
+				nodes[i] = createNode(std::piecewise_construct, std::forward_as_tuple(saved[i].key), std::tuple<>());
+			} else {
+				nodes[i] = createNode(saved[i].key, saved[i].value);
+			}
+		}
+
+		// Damaged links are only ever followed through nodes, never
+		// walked as a tree, until they are known to form one.
+		bool damaged = n > 0 && header.root >= n;
+		auto link = [&](NodePtr parent, uint32_t i) {
+			if (i == RB_FILE_NIL) {
+				return TNULL;
+			}
+			if (i >= n || nodes[i]->parent != nullptr || i == header.root) {
+				damaged = true; // out of range, or a second parent
+				return TNULL;
+			}
+			nodes[i]->parent = parent;
+			return nodes[i];
+		};
+		for (size_t i = 0; i < n && !damaged; i++) {
+			NodePtr node = nodes[i];
+			node->color = saved[i].color;
+			node->left = link(node, saved[i].left);
+			node->right = link(node, saved[i].right);
+		}
+		// every node now has at most one parent and the root has
+		// none, so the nodes under the root form a tree
+		root = n == 0 || damaged ? TNULL : nodes[header.root];
+		nodeCount = n;
+		if constexpr (OrderStats) {
+			postOrder([](NodePtr node) { update(node); });
+		}
+		if (damaged || checkInvariants() != nullptr) {
+			for (NodePtr node : nodes) {
+				destroyNode(node);
+			}
+			pool.release();
+			root = TNULL;
+			nodeCount = 0;
+			throw std::runtime_error("RBTree::load: damaged tree");
+		}
+	}
+
+	////////////////////////////////////////////////////////////
+	// Join, split and set operations
+	////////////////////////////////////////////////////////////
+
+	// Appends greater, whose keys must all be at least as large as
+	// this tree's, leaving it empty. O(log n) plus O(chunks) to take
+	// over greater's memory.
+	void join(RBTree &&greater) {
+		if (&greater == this || greater.root == TNULL) {
+			return;
+		}
+		size_t total = (nodeCount == UNKNOWN_SIZE || greater.nodeCount == UNKNOWN_SIZE)
+		                   ? UNKNOWN_SIZE : nodeCount + greater.nodeCount;
+		pool.adopt(std::move(greater.pool));
+		setRoot(joinSubtrees(root, greater.root));
+		nodeCount = total;
+		greater.root = TNULL;
+		greater.nodeCount = 0;
+		validate();
+	}
+
+	// Moves every element with a key of at least k into the returned
+	// tree in O(log n). The two trees share their memory until both
+	// are gone. Their sizes are recounted the next time size() is
+	// asked for.
+	RBTree split(const Key &k) {
+		RBTree out(comp);
+		out.pool = pool.share();
+		NodePtr less, rest;
+		splitBefore(root, k, less, rest);
+		setRoot(less);
+		out.setRoot(rest);
+		nodeCount = out.nodeCount = UNKNOWN_SIZE;
+		validate();
+		out.validate();
+		return out;
+	}
+
+	// The set operations take over other's nodes and leave it empty.
+	// They assume both trees hold unique keys, and where both have
+	// a key the element from this tree is kept. With m <= n elements
+	// they do O(m log(n / m + 1)) work, and the recursion is split
+	// over threads (0 picks one per core). Compare must be safe to
+	// call from several threads at once.
+
+	void unionWith(RBTree &&other, unsigned threads = 0) {
+		if (&other != this) {
+			combine(std::move(other), threads, &RBTree::unionOf);
+		}
+	}
+
+	void intersectWith(RBTree &&other, unsigned threads = 0) {
+		if (&other != this) {
+			combine(std::move(other), threads, &RBTree::intersectionOf);
+		}
+	}
+
+	// removes every key which is also in other
+	void differenceWith(RBTree &&other, unsigned threads = 0) {
+		if (&other == this) {
+			clear();
+		} else {
+			combine(std::move(other), threads, &RBTree::differenceOf);
+		}
+	}
+
+	// Inserts a batch of keys or key-value pairs by bulk loading them
+	// into a tree of their own and taking the union. Keys already in
+	// the tree, and repeats within the batch, keep the first element.
+	template <typename InputIt>
+	void insertMany(InputIt first, InputIt last, unsigned threads = 0) {
+		typedef typename std::iterator_traits<InputIt>::value_type Item;
+		std::vector<Item> items(first, last);
+		auto byKey = [this](const Item &a, const Item &b) {
+			return comp(itemKey(a), itemKey(b));
+		};
+		std::stable_sort(items.begin(), items.end(), byKey);
+		auto repeated = [this](const Item &a, const Item &b) {
+			return !comp(itemKey(a), itemKey(b));
+		};
+		items.erase(std::unique(items.begin(), items.end(), repeated), items.end());
+
+		RBTree batch(comp);
+		batch.bulkLoadSorted(items.begin(), items.end());
+		unionWith(std::move(batch), threads);
+	}
+
+	////////////////////////////////////////////////////////////
+	// std::map-like interface
+	////////////////////////////////////////////////////////////
+
+	iterator begin() {
+		return iterator(root == TNULL ? TNULL : minimum(root), this);
+	}
+
+	const_iterator begin() const {
+		return const_iterator(root == TNULL ? TNULL : minimum(root), this);
+	}
+
+	iterator end() {
+		return iterator(TNULL, this);
+	}
+
+	const_iterator end() const {
+		return const_iterator(TNULL, this);
+	}
+
+	const_iterator cbegin() const {
+		return begin();
+	}
+
+	const_iterator cend() const {
+		return end();
+	}
+
+	size_t size() const {
+		if (OrderStats) {
+			return subtreeSize(root);
+		}
+		if (nodeCount == UNKNOWN_SIZE) {
+			nodeCount = countSubtree(root);
+		}
+		return nodeCount;
+	}
+
+	bool empty() const {
+		return root == TNULL;
+	}
+
+	// Checks the whole tree in O(n): BST order, a black root without
+	// a parent, no red node with a red child, the same number of
+	// black nodes on every path, parent links that match the child
+	// links, the shared TNULL left as it was, and the node count
+	// (and, with OrderStats, every subtree size). Returns what is
+	// broken, or nullptr if nothing is.
+	const char *checkInvariants() const {
+		if (rbTreeNil.parent != nullptr || rbTreeNil.left != nullptr || rbTreeNil.right != nullptr ||
+		    rbTreeNil.color != 0) {
+			return "the TNULL sentinel was written to";
+		}
+		if (root == TNULL) {
+			return nodeCount == 0 || nodeCount == UNKNOWN_SIZE ? nullptr : "the node count is wrong";
+		}
+		if (root->parent != nullptr) {
+			return "the root has a parent";
+		}
+		if (root->color != 0) {
+			return "the root is red";
+		}
+		size_t count = 0;
+		const char *broken = nullptr;
+		if (checkSubtree(root, nullptr, nullptr, 0, count, broken) < 0) {
+			return broken;
+		}
+		if (nodeCount != UNKNOWN_SIZE && nodeCount != count) {
+			return "the node count is wrong";
+		}
+		return nullptr;
+	}
+
+	bool isValid() const {
+		return checkInvariants() == nullptr;
+	}
+
+	key_compare key_comp() const {
+		return comp;
+	}
+
+	// first element not less than k
+	iterator lower_bound(const Key &k) {
+		NodePtr x = root, result = TNULL;
+		while (x != TNULL) {
+			this->countComparison();
+			if (!comp(key(x), k)) {
+				result = x;
+				x = x->left;
+			} else {
+				x = x->right;
+			}
+		}
+		return iterator(result, this);
+	}
+
+	const_iterator lower_bound(const Key &k) const {
+		return const_cast<RBTree *>(this)->lower_bound(k);
+	}
+
+	// first element greater than k
+	iterator upper_bound(const Key &k) {
+		NodePtr x = root, result = TNULL;
+		while (x != TNULL) {
+			this->countComparison();
+			if (comp(k, key(x))) {
+				result = x;
+				x = x->left;
+			} else {
+				x = x->right;
+			}
+		}
+		return iterator(result, this);
+	}
+
+	const_iterator upper_bound(const Key &k) const {
+		return const_cast<RBTree *>(this)->upper_bound(k);
+	}
+
+	iterator find(const Key &k) {
+		iterator it = lower_bound(k);
+		return (it.node != TNULL && !comp(k, key(it.node))) ? it : end();
+	}
+
+	const_iterator find(const Key &k) const {
+		return const_cast<RBTree *>(this)->find(k);
+	}
+
+	// number of elements with key k
+	size_t count(const Key &k) const {
+		return std::distance(lower_bound(k), upper_bound(k));
+	}
+
+	////////////////////////////////////////////////////////////
+	// Order statistics (OrderStats = true only)
+	////////////////////////////////////////////////////////////
+
+	// the element with index i in key order, or end() if i >= size()
+	iterator select(size_t i) {
+		static_assert(OrderStats, "select needs an RBTree with OrderStats = true");
+		NodePtr x = root;
+		while (x != TNULL) {
+			size_t leftSize = subtreeSize(x->left);
+			if (i == leftSize) {
+				break;
+			}
+			if (i < leftSize) {
+				x = x->left;
+			} else {
+				i -= leftSize + 1;
+				x = x->right;
+			}
+		}
+		return iterator(x, this);
+	}
+
+	const_iterator select(size_t i) const {
+		return const_cast<RBTree *>(this)->select(i);
+	}
+
+	// number of elements with key less than k
+	size_t rank(const Key &k) const {
+		static_assert(OrderStats, "rank needs an RBTree with OrderStats = true");
+		size_t below = 0;
+		for (NodePtr x = root; x != TNULL;) {
+			if (comp(key(x), k)) {
+				below += subtreeSize(x->left) + 1;
+				x = x->right;
+			} else {
+				x = x->left;
+			}
+		}
+		return below;
+	}
+
+	// number of elements with low <= key < high
+	size_t countRange(const Key &low, const Key &high) const {
+		size_t end = rank(high), begin = rank(low);
+		return end > begin ? end - begin : 0;
+	}
+
+	// builds the element first, then keeps it only if its key is new
+	template <typename... Args>
+	std::pair<iterator, bool> emplace(Args &&...args) {
+		Node *node = createNode(std::forward<Args>(args)...);
+		NodePtr parent;
+		bool asLeft;
+		NodePtr existing = findSlot(node->kv.first, parent, asLeft);
+		if (existing != TNULL) {
+			destroyNode(node);
+			return std::make_pair(iterator(existing, this), false);
+		}
+		attachNode(node, parent, asLeft);
+		return std::make_pair(iterator(node, this), true);
+	}
+
+	// only builds the value if the key is new
+	template <typename K, typename... Args>
+	std::pair<iterator, bool> try_emplace(K &&k, Args &&...args) {
+		NodePtr parent;
+		bool asLeft;
+		NodePtr existing = findSlot(k, parent, asLeft);
+		if (existing != TNULL) {
+			return std::make_pair(iterator(existing, this), false);
+		}
+		Node *node = createNode(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(k)),
+		                        std::forward_as_tuple(std::forward<Args>(args)...));
+		attachNode(node, parent, asLeft);
+		return std::make_pair(iterator(node, this), true);
+	}
+
+	std::pair<iterator, bool> insert(const value_type &value) {
+		return emplace(value);
+	}
+
+	std::pair<iterator, bool> insert(value_type &&value) {
+		return emplace(std::move(value));
+	}
+
+	Value &operator[](const Key &k) {
+		return try_emplace(k).first->second;
+	}
+
+	Value &operator[](Key &&k) {
+		return try_emplace(std::move(k)).first->second;
+	}
+
+	Value &at(const Key &k) {
+		iterator it = find(k);
+		if (it == end()) {
+			throw std::out_of_range("RBTree::at");
+		}
+		return it->second;
+	}
+
+	const Value &at(const Key &k) const {
+		return const_cast<RBTree *>(this)->at(k);
+	}
+
+	// returns the element after the erased one
+	iterator erase(const_iterator pos) {
+		NodePtr next = successor(pos.node);
+		eraseNode(pos.node);
+		return iterator(next, this);
+	}
+
+	// erases every element with key k, returning how many there were
+	size_t erase(const Key &k) {
+		size_t erased = 0;
+		for (iterator it = find(k); it != end() && !comp(k, it->first); it = find(k)) {
+			eraseNode(it.node);
+			erased++;
+		}
+		return erased;
+	}
+
+	void clear() {
+		if (!std::is_trivially_destructible<Node>::value) {
+			destroySubtree(root);
+		}
+		pool.release();
+		root = TNULL;
+		nodeCount = 0;
+	}
+};
+
+#endif
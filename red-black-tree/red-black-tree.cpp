@@ -1,516 +1,532 @@
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include "bplus_tree.hpp"
+#include "compact_rbtree.hpp"
+#include "concurrent_rbtree.hpp"
+#include "counting_rbtree.hpp"
+#include "mapped_rbtree.hpp"
+#include "parent_free_rbtree.hpp"
+#include "persistent_rbtree.hpp"
+#include "rbtree.hpp"
 
 using namespace std;
 
-int comparisons = 0;
-unsigned long long total_bytes_used = 0;
-
-
-struct Node {
-	int data; 
-	Node *parent; 
-	Node *left; 
-	Node *right; 
-	int color; // 1 -> Red, 0 -> Black
-};
-
-typedef Node *NodePtr;
-
-// class For Red Black Tree
-class RBTree {
-private:
-	NodePtr root;
-	NodePtr TNULL;
-
-	// initializes the nodes with appropirate values
-	void initializeNULLNode(NodePtr node, NodePtr parent) {
-		node->data = 0;
-		node->parent = parent;
-		node->left = nullptr;
-		node->right = nullptr;
-		node->color = 0;
-	}
+// int set with per-instance comparison counting turned on
+typedef RBTree<int, RBNoValue, less<int>, allocator<pair<const int, RBNoValue>>, true> BenchTree;
+typedef BenchTree::Node Node;
 
-	void preOrder(NodePtr node) {
-		if (node != TNULL) {
-			cout<<node->data<<" ";
-			preOrder(node->left);
-			preOrder(node->right);
-		} 
-	}
 
-	void inOrder(NodePtr node) {
-		if (node != TNULL) {
-			inOrder(node->left);
-			cout<<node->data<<" ";
-			inOrder(node->right);
-		} 
+// the element count can be given as the first argument
+int main(int argc, char **argv) {
+	const int ARRAY_SIZE = argc > 1 ? atoi(argv[1]) : 1000000;
+	if (ARRAY_SIZE < 5) {
+		cerr << "usage: " << argv[0] << " [elements >= 5]" << endl;
+		return 1;
 	}
+	BenchTree bst;
+	vector<int> array(ARRAY_SIZE);
+	srand(time(NULL));
+	for (int i=0; i<ARRAY_SIZE; i++){
+		array[i] = rand() % 10000;
+	}
+
 
-	void postOrder(NodePtr node) {
-		if (node != TNULL) {
-			postOrder(node->left);
-			postOrder(node->right);
-			cout<<node->data<<" ";
-		} 
+	//Insert
+	auto begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		bst.insert(array[i]);
 	}
+	auto end = chrono::high_resolution_clock::now();
+	auto elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "---------INSERTION-----------------------------------------------" << endl;
+	cout << "Time to insert " << ARRAY_SIZE << " elements: 				" << elapsed << " nanoseconds" << endl; 
+	cout << "Total Comparisons to insert " << ARRAY_SIZE << " elements: 		" << bst.comparisons() << endl;
+	cout << "Average Comparisons per element: 			" << float(bst.comparisons())/ARRAY_SIZE << endl;
+	cout << "The Theoretical Insetion O(log(n)) is: 			" << log2(float(ARRAY_SIZE)) << endl;
+	cout << "Total bytes used for Tree: 				" << bst.calculateMemoryUsage() << endl;
+	cout << "Size of each node in Tree: 				" << sizeof(Node) << endl;
+	cout << "Bytes reserved by node pool: 				" << bst.reservedBytes() << " in " << bst.chunkCount() << " chunks" << endl;
+	cout << "Theoretical Space complexity O(n) for " << ARRAY_SIZE << " elements:	" << ARRAY_SIZE*sizeof(Node) << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-	NodePtr searchTree(NodePtr node, int key) {
-		if (node == TNULL || key == node->data) {
-			return node;
+	//Search
+	int array_jump = ARRAY_SIZE * 0.2;
+    int search_array[5] = {array[0],array[array_jump],array[2*array_jump],array[3*array_jump],array[4*array_jump]};
+	bst.resetStats();
+	Node *result;
+	begin = chrono::high_resolution_clock::now();
+	for(int i = 0; i < 5; i++) {
+		result = bst.searchTree(search_array[i]);
+		if (result == nullptr) {
+			cout << search_array[i] << " Not found in tree" << endl;
+		} else {
+			//cout << search_array[i] << " Found in tree" << endl;
 		}
-		comparisons++;
-		if (key < node->data) {
-			NodePtr leftResult = searchTree(node->left, key);
-			return leftResult == TNULL ? nullptr : leftResult;
-		} 
-		NodePtr rightResult = searchTree(node->right, key);
-		return rightResult == TNULL ? nullptr : rightResult;
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Searching-------------------------------------------" << endl;
+	cout << "Total Time to complete 5 searches:			" << elapsed << " nanoseconds" << endl;
+	cout << "Total Comparisons for 5 searches: 			" << bst.comparisons() << endl;
+	cout << "Average Comparisons per search:				" << float(bst.comparisons())/5 << endl;
+	cout << "Theoretical complexity for search(O(logn)):		" << log2(ARRAY_SIZE) << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
 
-	// fix the rb tree modified by the delete operation
-	void fixDelete(NodePtr x) {
-		NodePtr s;
-		while (x != root && x->color == 0) {
-			if (x == x->parent->left) {
-				s = x->parent->right;
-				if (s->color == 1) {
-					// case 3.1
-					s->color = 0;
-					x->parent->color = 1;
-					leftRotate(x->parent);
-					s = x->parent->right;
-				}
+	//Delete
+	bst.resetStats();
+	begin = chrono::high_resolution_clock::now();
+	for(int i = 0; i < 5; i++) {
+		if (!bst.deleteNode(search_array[i])) {
+			cout << search_array[i] << " Not found in tree" << endl;
+		}
+	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Deleting-------------------------------------------" << endl;
+	cout << "Total Time to complete 5 deletions:			" << elapsed << " nanoseconds" << endl;
+	cout << "Total Comparisons for 5 deletions: 			" << bst.comparisons() << endl;
+	cout << "Average Comparisons per deletions:			" << float(bst.comparisons())/5 << endl;
+	cout << "Theoretical complexity for deletions(O(logn)):		" << log2(ARRAY_SIZE) << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-				if (s->left->color == 0 && s->right->color == 0) {
-					// case 3.2
-					s->color = 1;
-					x = x->parent;
-				} else {
-					if (s->right->color == 0) {
-						// case 3.3
-						s->left->color = 0;
-						s->color = 1;
-						rightRotate(s);
-						s = x->parent->right;
-					} 
-
-					// case 3.4
-					s->color = x->parent->color;
-					x->parent->color = 0;
-					s->right->color = 0;
-					leftRotate(x->parent);
-					x = root;
-				}
-			} else {
-				s = x->parent->left;
-				if (s->color == 1) {
-					// case 3.1
-					s->color = 0;
-					x->parent->color = 1;
-					rightRotate(x->parent);
-					s = x->parent->left;
-				}
 
-				if (s->right->color == 0 && s->right->color == 0) {
-					// case 3.2
-					s->color = 1;
-					x = x->parent;
-				} else {
-					if (s->left->color == 0) {
-						// case 3.3
-						s->right->color = 0;
-						s->color = 1;
-						leftRotate(s);
-						s = x->parent->left;
-					} 
-
-					// case 3.4
-					s->color = x->parent->color;
-					x->parent->color = 0;
-					s->left->color = 0;
-					rightRotate(x->parent);
-					x = root;
-				}
-			} 
-		}
-		x->color = 0;
+	//Duplicate keys
+	// the same keys again, but each distinct key is stored once
+	CountingRBTree<int, less<int>, unsigned, allocator<pair<const int, unsigned>>, true> counted;
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		counted.insert(array[i]);
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Counted duplicates--------------------------------------" << endl;
+	cout << "Time to insert " << ARRAY_SIZE << " elements: 				" << elapsed << " nanoseconds" << endl;
+	cout << "Average Comparisons per element: 			" << float(counted.comparisons())/ARRAY_SIZE << endl;
+	cout << "Distinct keys stored: 					" << counted.distinctKeys() << endl;
+	cout << "Total bytes used for Tree: 				" << counted.calculateMemoryUsage() << endl;
 
-	void rbTransplant(NodePtr u, NodePtr v){
-		if (u->parent == nullptr) {
-			root = v;
-		} else if (u == u->parent->left){
-			u->parent->left = v;
-		} else {
-			u->parent->right = v;
+	counted.resetStats();
+	begin = chrono::high_resolution_clock::now();
+	for(int i = 0; i < 5; i++) {
+		if (!counted.deleteNode(search_array[i])) {
+			cout << search_array[i] << " Not found in tree" << endl;
 		}
-		v->parent = u->parent;
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Total Time to complete 5 deletions:			" << elapsed << " nanoseconds" << endl;
+	cout << "Average Comparisons per deletion:			" << float(counted.comparisons())/5 << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-	void deleteNode(NodePtr node, int key) {
-		// find the node containing key
-		NodePtr z = TNULL;
-		NodePtr x, y;
-		while (node != TNULL){
-			if (node->data == key) {
-				z = node;
-			}
 
-			if (node->data <= key) {
-				node = node->right;
-			} else {
-				node = node->left;
-			}
-			comparisons++;
-		}
+	//Bulk load
+	// the same keys, built bottom-up instead of inserted one by one
+	vector<int> sorted(array);
+	sort(sorted.begin(), sorted.end());
+	BenchTree bulk;
+	begin = chrono::high_resolution_clock::now();
+	bulk.bulkLoad(array.begin(), array.end());
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Bulk load-----------------------------------------------" << endl;
+	cout << "Time to sort and load " << ARRAY_SIZE << " elements: 			" << elapsed << " nanoseconds" << endl;
 
-		if (z == TNULL) {
-			cout<<"Couldn't find key in the tree"<<endl;
-			return;
-		} 
-
-		y = z;
-		int y_original_color = y->color;
-		if (z->left == TNULL) {
-			x = z->right;
-			rbTransplant(z, z->right);
-		} else if (z->right == TNULL) {
-			x = z->left;
-			rbTransplant(z, z->left);
-		} else {
-			y = minimum(z->right);
-			y_original_color = y->color;
-			x = y->right;
-			if (y->parent == z) {
-				x->parent = y;
-			} else {
-				rbTransplant(y, y->right);
-				y->right = z->right;
-				y->right->parent = y;
-			}
+	begin = chrono::high_resolution_clock::now();
+	bulk.bulkLoadSorted(sorted.begin(), sorted.end());
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Time to load " << ARRAY_SIZE << " sorted elements: 			" << elapsed << " nanoseconds" << endl;
+	cout << "Total Comparisons to load: 				" << bulk.comparisons() << endl;
+	cout << "Bytes reserved by node pool: 				" << bulk.reservedBytes() << " in " << bulk.chunkCount() << " chunks" << endl;
 
-			rbTransplant(z, y);
-			y->left = z->left;
-			y->left->parent = y;
-			y->color = z->color;
-		}
-		delete z;
-		if (y_original_color == 0){
-			fixDelete(x);
-		}
-	}
-	
-	// fix the red-black tree
-	void fixInsert(NodePtr k){
-		NodePtr u;
-		while (k->parent->color == 1) {
-			if (k->parent == k->parent->parent->right) {
-				u = k->parent->parent->left; // uncle
-				if (u->color == 1) {
-					// case 3.1
-					u->color = 0;
-					k->parent->color = 0;
-					k->parent->parent->color = 1;
-					k = k->parent->parent;
-				} else {
-					if (k == k->parent->left) {
-						// case 3.2.2
-						k = k->parent;
-						rightRotate(k);
-					}
-					// case 3.2.1
-					k->parent->color = 0;
-					k->parent->parent->color = 1;
-					leftRotate(k->parent->parent);
-				}
-			} else {
-				u = k->parent->parent->right; // uncle
-
-				if (u->color == 1) {
-					// mirror case 3.1
-					u->color = 0;
-					k->parent->color = 0;
-					k->parent->parent->color = 1;
-					k = k->parent->parent;	
-				} else {
-					if (k == k->parent->right) {
-						// mirror case 3.2.2
-						k = k->parent;
-						leftRotate(k);
-					}
-					// mirror case 3.2.1
-					k->parent->color = 0;
-					k->parent->parent->color = 1;
-					rightRotate(k->parent->parent);
-				}
-			}
-			if (k == root) {
-				break;
-			}
+	bulk.resetStats();
+	begin = chrono::high_resolution_clock::now();
+	for(int i = 0; i < 5; i++) {
+		if (bulk.searchTree(search_array[i]) == nullptr) {
+			cout << search_array[i] << " Not found in tree" << endl;
 		}
-		root->color = 0;
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Total Time to complete 5 searches:			" << elapsed << " nanoseconds" << endl;
+	cout << "Average Comparisons per search:				" << float(bulk.comparisons())/5 << endl;
 
-	void print(NodePtr root, string indent, bool last) {
-	   	if (root != TNULL) {
-		   cout<<indent;
-		   if (last) {
-		      cout<<"R----";
-		      indent += "     ";
-		   } else {
-		      cout<<"L----";
-		      indent += "|    ";
-		   }
-            
-           string sColor = root->color?"RED":"BLACK";
-		   cout<<root->data<<"("<<sColor<<")"<<endl;
-		   print(root->left, indent, false);
-		   print(root->right, indent, true);
-		}
-	}
+	// keys 0 to 999 make up about a tenth of the tree
+	long long scanned = 0;
+	begin = chrono::high_resolution_clock::now();
+	bulk.rangeScan(0, 1000, [&](const pair<const int, RBNoValue> &element) {
+		scanned += element.first;
+	});
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Time to scan keys 0 to 999 in order:			" << elapsed << " nanoseconds (key sum " << scanned << ")" << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-	size_t calculateMemoryUsage(NodePtr node) {
-		if (node == TNULL) {
-			return 0;
-		}
-		// Size of current node + sizes of left and right subtrees
-		return sizeof(Node) + calculateMemoryUsage(node->left) + calculateMemoryUsage(node->right);
-	}
 
-public:
-	RBTree() {
-		TNULL = new Node;
-		TNULL->color = 0;
-		TNULL->left = nullptr;
-		TNULL->right = nullptr;
-		root = TNULL;
+	//Save, load and map
+	const char *savePath = "rbt_save.bin";
+	begin = chrono::high_resolution_clock::now();
+	{
+		ofstream saveFile(savePath, ios::binary);
+		bulk.save(saveFile);
 	}
-
-	// Pre-Order traversal
-	// Node->Left->Right
-	void preorder() {
-		preOrder(this->root);
+	end = chrono::high_resolution_clock::now();
+	long long saveTime = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	BenchTree loaded;
+	begin = chrono::high_resolution_clock::now();
+	{
+		ifstream loadFile(savePath, ios::binary);
+		loaded.load(loadFile);
 	}
-
-	// In-Order traversal
-	// Left->Node->Right
-	void inorder() {
-		inOrder(this->root);
+	end = chrono::high_resolution_clock::now();
+	long long loadTime = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	begin = chrono::high_resolution_clock::now();
+	MappedRBTree<int> mapped(savePath);
+	int mappedHits = 0;
+	for (int i = 0; i < 5; i++) {
+		mappedHits += mapped.contains(search_array[i]);
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Save, load and map--------------------------------------" << endl;
+	cout << "Time to save / load " << mapped.size() << " elements:		" << saveTime << " / " << loadTime << " nanoseconds" << endl;
+	cout << "Time to map the file and do 5 searches:		" << elapsed << " nanoseconds (" << mappedHits << " found)" << endl;
+	cout << "File size: 						" << mapped.mappedSize() << endl;
+	cout << "Loaded tree matches, invariants hold:		" << (loaded.size() == bulk.size() && equal(loaded.begin(), loaded.end(), bulk.begin(), [](const auto &a, const auto &b) { return a.first == b.first; }) ? "yes" : "NO") << " " << (loaded.isValid() ? "yes" : "NO") << endl;
+	cout << "-------------------------------------------------------------------" << endl;
+	remove(savePath);
 
-	// Post-Order traversal
-	// Left->Right->Node
-	void postorder() {
-		postOrder(this->root);
-	}
 
-	//Search for value k
-	NodePtr searchTree(int k) {
-		return searchTree(this->root, k);
+	//Order statistics
+	// the same inserts into a tree which also keeps subtree sizes
+	RBTree<int, RBNoValue, less<int>, allocator<pair<const int, RBNoValue>>, false, true> ranked;
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		ranked.insert(array[i]);
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Order statistics----------------------------------------" << endl;
+	cout << "Time to insert " << ARRAY_SIZE << " elements: 				" << elapsed << " nanoseconds" << endl;
+	cout << "Size of each node in Tree: 				" << sizeof(decltype(ranked)::Node) << endl;
 
-	// return node with min value
-	NodePtr minimum(NodePtr node) {
-		while (node->left != TNULL) {
-			node = node->left;
-		}
-		return node;
+	const int PERCENTILES = 1000;
+	long long picked = 0;
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < PERCENTILES; i++) {
+		picked += ranked.select(size_t(i) * ARRAY_SIZE / PERCENTILES)->first;
+		picked += ranked.rank(array[i]);
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Time for " << PERCENTILES << " select and " << PERCENTILES << " rank queries:		" << elapsed << " nanoseconds (checksum " << picked << ")" << endl;
+	cout << "Median and 99th percentile keys:			" << ranked.select(ARRAY_SIZE / 2)->first << " " << ranked.select(size_t(ARRAY_SIZE) * 99 / 100)->first << endl;
+	cout << "Keys from 0 to 999:					" << ranked.countRange(0, 1000) << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-	// return node with max value
-	NodePtr maximum(NodePtr node) {
-		while (node->right != TNULL) {
-			node = node->right;
-		}
-		return node;
+
+	//Set operations
+	// two sets of ARRAY_SIZE distinct keys each, half of them shared
+	vector<int> keysA, keysB;
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		keysA.push_back(2 * i);
+		keysB.push_back(2 * (i + ARRAY_SIZE / 2) + i % 2);
 	}
+	RBTree<int> setA, setB;
+	setA.bulkLoadSorted(keysA.begin(), keysA.end());
+	setB.bulkLoadSorted(keysB.begin(), keysB.end());
+	cout << "-----------Set operations (join / split)---------------------------" << endl;
 
-	// rotate left at node x
-	void leftRotate(NodePtr x) {
-		NodePtr y = x->right;
-		x->right = y->left;
-		if (y->left != TNULL) {
-			y->left->parent = x;
-		}
-		y->parent = x->parent;
-		if (x->parent == nullptr) {
-			this->root = y;
-		} else if (x == x->parent->left) {
-			x->parent->left = y;
-		} else {
-			x->parent->right = y;
+	RBTree<int> byKey(setA);
+	begin = chrono::high_resolution_clock::now();
+	for (int key : keysB) {
+		byKey.try_emplace(key);
+	}
+	end = chrono::high_resolution_clock::now();
+	cout << "Union one key at a time:				" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
+
+	const char *setNames[] = {"Union", "Intersection", "Difference"};
+	for (int op = 0; op < 3; op++) {
+		for (unsigned threads : {1u, 0u}) {
+			RBTree<int> a(setA), b(setB);
+			begin = chrono::high_resolution_clock::now();
+			if (op == 0) {
+				a.unionWith(move(b), threads);
+			} else if (op == 1) {
+				a.intersectWith(move(b), threads);
+			} else {
+				a.differenceWith(move(b), threads);
+			}
+			end = chrono::high_resolution_clock::now();
+			cout << setNames[op] << (threads == 1 ? " on 1 thread" : " on every core") << ":			" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds (" << a.size() << " keys)" << endl;
 		}
-		y->left = x;
-		x->parent = y;
 	}
+	cout << "-------------------------------------------------------------------" << endl;
+
 
-	// rotate right at node x
-	void rightRotate(NodePtr x) {
-		NodePtr y = x->left;
-		x->left = y->right;
-		if (y->right != TNULL) {
-			y->right->parent = x;
+	//Concurrent reads
+	// every reader looks up the same number of keys, so with enough
+	// cores the total time should stay flat as readers are added
+	ConcurrentRBTree<int> concurrent;
+	for (int key : keysA) {
+		concurrent.insert(key);
+	}
+	mutex setALock;
+	const int LOOKUPS = 1000000;
+	// hits are counted so the compiler cannot drop unused lookups
+	atomic<size_t> hits{0};
+	auto timeReaders = [&](unsigned readers, auto lookup) {
+		vector<thread> threads;
+		auto start = chrono::high_resolution_clock::now();
+		for (unsigned r = 0; r < readers; r++) {
+			threads.emplace_back([&, r] {
+				size_t found = 0;
+				for (int i = 0; i < LOOKUPS; i++) {
+					found += lookup(keysA[(size_t(i) * 7919 + r * 104729) % ARRAY_SIZE]);
+				}
+				hits += found;
+			});
 		}
-		y->parent = x->parent;
-		if (x->parent == nullptr) {
-			this->root = y;
-		} else if (x == x->parent->right) {
-			x->parent->right = y;
-		} else {
-			x->parent->left = y;
+		for (auto &t : threads) {
+			t.join();
 		}
-		y->right = x;
-		x->parent = y;
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count();
+	};
+	cout << "-----------Concurrent reads (" << LOOKUPS << " lookups per reader)------------" << endl;
+	for (unsigned readers : {1u, 2u, 4u}) {
+		auto lockFree = timeReaders(readers, [&](int key) {
+			return concurrent.contains(key);
+		});
+		auto locked = timeReaders(readers, [&](int key) {
+			lock_guard<mutex> lock(setALock);
+			return setA.find(key) != setA.end();
+		});
+		cout << readers << " readers, seqlock / global mutex:		" << lockFree << " / " << locked << " nanoseconds" << endl;
 	}
+	cout << "Keys found, over both trees:				" << hits << endl;
+	cout << "Reads which fell back to the lock:			" << concurrent.lockedReads() << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-	// insert the key to the tree in its appropriate position then fix the tree
-	void insert(int key) {
-		// Ordinary Binary Search Insertion
-		NodePtr node = new Node;
-		node->parent = nullptr;
-		node->data = key;
-		node->left = TNULL;
-		node->right = TNULL;
-		node->color = 1; // new node must be red
-
-
-		NodePtr y = nullptr;
-		NodePtr x = this->root;
 
-		while (x != TNULL) {
-			y = x;
-			if (node->data < x->data) {
-				x = x->left;
-			} else {
-				x = x->right;
-			}
-			comparisons++;
-		}
-		total_bytes_used += sizeof(y);
-
-		// y is parent of x
-		node->parent = y;
-		if (y == nullptr) {
-			root = node;
-		} else if (node->data < y->data) {
-			y->left = node;
-		} else {
-			y->right = node;
-		}
+	//Compact layout
+	CompactRBTree compact;
+	compact.reserve(ARRAY_SIZE);
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		compact.insert(array[i]);
+	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Compact (32-bit index) layout---------------------------" << endl;
+	cout << "Time to insert " << ARRAY_SIZE << " elements: 				" << elapsed << " nanoseconds" << endl;
+	cout << "Total bytes used for Tree: 				" << compact.calculateMemoryUsage() << endl;
+	cout << "Size of each node in Tree: 				" << sizeof(CompactNode) << endl;
 
-		// if new node is a root node, simply return
-		if (node->parent == nullptr){
-			node->color = 0;
-			return;
+	begin = chrono::high_resolution_clock::now();
+	for(int i = 0; i < 5; i++) {
+		if (!compact.contains(search_array[i])) {
+			cout << search_array[i] << " Not found in tree" << endl;
 		}
+	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Total Time to complete 5 searches:			" << elapsed << " nanoseconds" << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-		// if the grandparent is null, simply return
-		if (node->parent->parent == nullptr) {
-			return;
-		}
 
-		// Fix the tree
-		fixInsert(node);
+	//Parent-free layout
+	ParentFreeRBTree parentFree;
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		parentFree.insert(array[i]);
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "-----------Parent-free layout--------------------------------------" << endl;
+	cout << "Time to insert " << ARRAY_SIZE << " elements: 				" << elapsed << " nanoseconds" << endl;
+	cout << "Total bytes used for Tree: 				" << parentFree.calculateMemoryUsage() << endl;
+	cout << "Size of each node in Tree: 				" << sizeof(PFNode) << endl;
 
-	NodePtr getRoot(){
-		return this->root;
+	begin = chrono::high_resolution_clock::now();
+	for(int i = 0; i < 5; i++) {
+		if (!parentFree.deleteNode(search_array[i])) {
+			cout << search_array[i] << " Not found in tree" << endl;
+		}
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	cout << "Total Time to complete 5 deletions:			" << elapsed << " nanoseconds" << endl;
+	cout << "Red-black invariants hold:				" << (parentFree.isValid() ? "yes" : "NO") << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-	// delete the node from the tree
-	void deleteNode(int data) {
-		deleteNode(this->root, data);
-	}
 
-	// print the tree structure
-	void prettyPrint() {
-	    if (root) {
-    		print(this->root, "", true);
-	    }
+	//Persistent snapshots
+	PersistentRBTree<int> persistent;
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		persistent.insert(array[i]);
 	}
+	begin = chrono::high_resolution_clock::now();
+	PersistentRBTree<int>::Snapshot snapshot = persistent.snapshot();
+	end = chrono::high_resolution_clock::now();
+	long long snapshotTime = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	begin = chrono::high_resolution_clock::now();
+	BenchTree copied(bst);
+	end = chrono::high_resolution_clock::now();
+	long long copyTime = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
 
-	size_t calculateMemoryUsage(){
-		return calculateMemoryUsage(this->root);
+	// change a tenth of the tree while the snapshot is held
+	int changes = ARRAY_SIZE / 10;
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < changes; i++)
+	{
+		persistent.deleteNode(array[i]);
+		persistent.insert(array[i] + 10000);
 	}
+	end = chrono::high_resolution_clock::now();
+	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
+	bool unchanged = snapshot.size() == size_t(ARRAY_SIZE) && !snapshot.contains(array[0] + 10000);
+	cout << "-----------Persistent snapshots------------------------------------" << endl;
+	cout << "Time to take a snapshot / copy an RBTree:		" << snapshotTime << " / " << copyTime << " nanoseconds" << endl;
+	cout << "Time for " << changes << " deletes and inserts after it:		" << elapsed << " nanoseconds" << endl;
+	cout << "Nodes copied instead of changed in place:		" << persistent.nodesCopied() << " of " << ARRAY_SIZE << endl;
+	cout << "Snapshot unchanged, tree invariants hold:		" << (unchanged ? "yes" : "NO") << " " << (persistent.isValid() ? "yes" : "NO") << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-};
 
+	//B+-tree
+	// distinct keys in random order, so both trees hold a million keys
+	vector<int> shuffled(keysA);
+	shuffle(shuffled.begin(), shuffled.end(), mt19937(42));
+	RBTree<int> redBlack;
+	BPlusTree bplus;
+	auto timeIndex = [&](auto &index, auto lookup) {
+		auto start = chrono::high_resolution_clock::now();
+		for (int key : shuffled) {
+			index.insert(key);
+		}
+		auto inserted = chrono::high_resolution_clock::now();
+		size_t bytes = index.calculateMemoryUsage();
+		size_t hits = 0;
+		for (int i = 0; i < ARRAY_SIZE; i++) {
+			hits += lookup(shuffled[(size_t(i) * 7919) % ARRAY_SIZE]);
+		}
+		auto searched = chrono::high_resolution_clock::now();
+		for (int i = 0; i < ARRAY_SIZE / 2; i++) {
+			index.deleteNode(keysA[i]);
+		}
+		auto deleted = chrono::high_resolution_clock::now();
+		return vector<long long>{chrono::duration_cast<chrono::nanoseconds>(inserted - start).count(),
+		                         chrono::duration_cast<chrono::nanoseconds>(searched - inserted).count(),
+		                         chrono::duration_cast<chrono::nanoseconds>(deleted - searched).count(),
+		                         (long long)hits, (long long)bytes};
+	};
+	auto redBlackTimes = timeIndex(redBlack, [&](int key) {
+		return redBlack.searchTree(key) != nullptr;
+	});
+	auto bplusTimes = timeIndex(bplus, [&](int key) {
+		return bplus.contains(key);
+	});
+	cout << "-----------B+-tree vs RBTree (" << ARRAY_SIZE << " distinct keys)---------------" << endl;
+	cout << "Insert, RBTree / B+-tree:				" << redBlackTimes[0] << " / " << bplusTimes[0] << " nanoseconds" << endl;
+	cout << "Search, RBTree / B+-tree:				" << redBlackTimes[1] << " / " << bplusTimes[1] << " nanoseconds" << endl;
+	cout << "Delete half, RBTree / B+-tree:				" << redBlackTimes[2] << " / " << bplusTimes[2] << " nanoseconds" << endl;
+	cout << "Keys found, RBTree / B+-tree:				" << redBlackTimes[3] << " / " << bplusTimes[3] << endl;
+	cout << "Total bytes used, RBTree / B+-tree:			" << redBlackTimes[4] << " / " << bplusTimes[4] << endl;
+	cout << "B+-tree height and invariants hold:			" << bplus.height() << " " << (bplus.isValid() ? "yes" : "NO") << endl;
+	cout << "-------------------------------------------------------------------" << endl;
 
-int main() {
-	const int ARRAY_SIZE = 1000000;
-	RBTree bst;
-	int array[ARRAY_SIZE];
-	srand(time(NULL));
-	for (int i=0; i<ARRAY_SIZE; i++){
-		array[i] = rand() % 10000;
+
+	//Batched lookups
+	// the million shuffled keys again, looked up in setA
+	vector<RBTree<int>::Node *> batchResults(ARRAY_SIZE);
+	size_t batchHits = 0;
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		batchHits += setA.searchTree(shuffled[i]) != nullptr;
 	}
+	end = chrono::high_resolution_clock::now();
+	cout << "-----------Batched lookups-----------------------------------------" << endl;
+	cout << "One searchTree per key:					" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
 
+	begin = chrono::high_resolution_clock::now();
+	setA.searchBatch(shuffled.data(), shuffled.size(), batchResults.data());
+	end = chrono::high_resolution_clock::now();
+	batchHits += count_if(batchResults.begin(), batchResults.end(), [](RBTree<int>::Node *node) { return node != nullptr; });
+	cout << "searchBatch with prefetching:				" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
 
-	//Insert
-	auto begin = chrono::high_resolution_clock::now();
-	for (int i = 0; i < ARRAY_SIZE; i++)
-	{
-		bst.insert(array[i]);
-	}
-	auto end = chrono::high_resolution_clock::now();
-	auto elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
-	cout << "---------INSERTION-----------------------------------------------" << endl;
-	cout << "Time to insert " << ARRAY_SIZE << " elements: 				" << elapsed << " nanoseconds" << endl; 
-	cout << "Total Comparisons to insert " << ARRAY_SIZE << " elements: 		" << comparisons << endl;
-	cout << "Average Comparisons per element: 			" << float(comparisons)/ARRAY_SIZE << endl;
-	cout << "The Theoretical Insetion O(log(n)) is: 			" << log2(float(ARRAY_SIZE)) << endl;
-	cout << "Total bytes used for Tree: 				" << bst.calculateMemoryUsage() << endl;
-	cout << "Size of each node in Tree: 				" << sizeof(Node) << endl;
-	cout << "Theoretical Space complexity O(n) for " << ARRAY_SIZE << " elements:	" << ARRAY_SIZE*sizeof(Node) << endl;
+	sort(shuffled.begin(), shuffled.end());
+	begin = chrono::high_resolution_clock::now();
+	setA.searchSortedBatch(shuffled.data(), shuffled.size(), batchResults.data());
+	end = chrono::high_resolution_clock::now();
+	batchHits += count_if(batchResults.begin(), batchResults.end(), [](RBTree<int>::Node *node) { return node != nullptr; });
+	cout << "searchSortedBatch on the sorted keys:			" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
+	cout << "Keys found, over all three:				" << batchHits << endl;
 	cout << "-------------------------------------------------------------------" << endl;
 
-	//Search
-	int array_jump = ARRAY_SIZE * 0.2;
-    int search_array[5] = {array[0],array[array_jump],array[2*array_jump],array[3*array_jump],array[4*array_jump]};
-	comparisons = 0;
-	NodePtr result;
+
+	//Against the standard containers
+	// unique keys counted with operator[], then every key looked up
+	RBTree<int, int> counts;
+	map<int, int> stdCounts;
+	set<int> stdSet;
+	long long found = 0;
+
+	cout << "-----------RBTree<int, int> vs std::map / std::set----------------" << endl;
 	begin = chrono::high_resolution_clock::now();
-	for(int i = 0; i < 5; i++) {
-		result = bst.searchTree(search_array[i]);
-		if (result == nullptr) {
-			cout << search_array[i] << " Not found in tree" << endl;
-		} else {
-			//cout << search_array[i] << " Found in tree" << endl;
-		}
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		counts[array[i]]++;
 	}
 	end = chrono::high_resolution_clock::now();
-	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
-	cout << "-----------Searching-------------------------------------------" << endl;
-	cout << "Total Time to complete 5 searches:			" << elapsed << " nanoseconds" << endl;
-	cout << "Total Comparisons for 5 searches: 			" << comparisons << endl;
-	cout << "Average Comparisons per search:				" << float(comparisons)/5 << endl;
-	cout << "Theoretical complexity for search(O(logn)):		" << log2(ARRAY_SIZE) << endl;
-	cout << "-------------------------------------------------------------------" << endl;
+	cout << "RBTree operator[] for " << ARRAY_SIZE << " keys:			" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
 
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		stdCounts[array[i]]++;
+	}
+	end = chrono::high_resolution_clock::now();
+	cout << "std::map operator[] for " << ARRAY_SIZE << " keys:			" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
 
-	//Delete
-	comparisons = 0;
 	begin = chrono::high_resolution_clock::now();
-	for(int i = 0; i < 5; i++) {
-		result = bst.searchTree(search_array[i]);
-		if (result == nullptr) {
-			cout << search_array[i] << " Not found in tree" << endl;
-		} else {
-			//cout << search_array[i] << " Found in tree" << endl;
-		}
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		stdSet.insert(array[i]);
 	}
 	end = chrono::high_resolution_clock::now();
-	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
-	elapsed = chrono::duration_cast<chrono::nanoseconds>(end-begin).count();
-	cout << "-----------Deleting-------------------------------------------" << endl;
-	cout << "Total Time to complete 5 deletions:			" << elapsed << " nanoseconds" << endl;
-	cout << "Total Comparisons for 5 deletions: 			" << comparisons << endl;
-	cout << "Average Comparisons per deletions:			" << float(comparisons)/5 << endl;
-	cout << "Theoretical complexity for deletions(O(logn)):		" << log2(ARRAY_SIZE) << endl;
+	cout << "std::set insert for " << ARRAY_SIZE << " keys:			" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
+
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		found += counts.find(array[i])->second;
+	}
+	end = chrono::high_resolution_clock::now();
+	cout << "RBTree find for " << ARRAY_SIZE << " keys:				" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
+
+	begin = chrono::high_resolution_clock::now();
+	for (int i = 0; i < ARRAY_SIZE; i++) {
+		found -= stdCounts.find(array[i])->second;
+	}
+	end = chrono::high_resolution_clock::now();
+	cout << "std::map find for " << ARRAY_SIZE << " keys:			" << chrono::duration_cast<chrono::nanoseconds>(end-begin).count() << " nanoseconds" << endl;
+	cout << "Distinct keys (RBTree / std::map / std::set):		" << counts.size() << " / " << stdCounts.size() << " / " << stdSet.size() << endl;
+	cout << "Counts agree:						" << (found == 0 && equal(counts.begin(), counts.end(), stdCounts.begin()) ? "yes" : "NO") << endl;
 	cout << "-------------------------------------------------------------------" << endl;
 
 
@@ -0,0 +1,503 @@
+// Randomized stress test for the trees' rebalancing. The trees are
+// built with RBTREE_VALIDATE, so every insert, delete, join, split
+// and set operation of RBTree, PersistentRBTree (and the snapshots
+// it shares) and CompactRBTree checks all of the red-black
+// invariants before returning. ParentFreeRBTree and BPlusTree are
+// checked with isValid() after every change. The contents of each
+// are compared with std::multiset, std::set or std::map as it goes,
+// and ConcurrentRBTree is also read from other threads while one
+// writes (build with -fsanitize=thread to check for data races).
+// The first broken invariant or wrong answer stops the run with the
+// seed and operation that found it.
+//
+// Arguments are name=value pairs, all optional:
+//   ops=N     operations per tree (default 100000; a soak might
+//             use 1000000, which takes several minutes)
+//   keys=K    keys are drawn from [0, K) (default 2000)
+//   seed=S    random seed (default: the time)
+
+#ifndef RBTREE_VALIDATE
+#define RBTREE_VALIDATE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bplus_tree.hpp"
+#include "compact_rbtree.hpp"
+#include "concurrent_rbtree.hpp"
+#include "counting_rbtree.hpp"
+#include "parent_free_rbtree.hpp"
+#include "persistent_rbtree.hpp"
+#include "rbtree.hpp"
+
+using namespace std;
+
+typedef RBTree<int> MultiTree;
+typedef RBTree<int, int, less<int>, allocator<pair<const int, int>>, false, true> RankedMap;
+
+// the operation being run, for the failure report
+static size_t currentOp = 0;
+
+struct Options {
+	size_t ops = 100000;
+	int keys = 2000;
+	unsigned long seed = chrono::steady_clock::now().time_since_epoch().count();
+};
+
+static void require(bool holds, const string &what) {
+	if (!holds) {
+		throw logic_error(what);
+	}
+}
+
+// The chance of inserting rather than deleting swings between 10%
+// and 90% over each stretch of ops, so the tree keeps growing until
+// most keys are in and shrinking until it is nearly empty, and both
+// fixInsert and every case of fixDelete run at every size.
+static bool chooseInsert(size_t op, size_t period, mt19937_64 &random) {
+	double phase = double(op % period) / period;
+	double insertChance = phase < 0.5 ? 0.9 : 0.1;
+	return uniform_real_distribution<double>(0, 1)(random) < insertChance;
+}
+
+// insert(key) and deleteNode with duplicate keys, plus split and join
+static void stressMultiTree(const Options &options, mt19937_64 &random) {
+	MultiTree tree;
+	multiset<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (op % 997 == 0) {
+			// split off the keys >= k and join them back on
+			MultiTree greater = tree.split(k);
+			require(tree.size() + greater.size() == expected.size(), "split lost elements");
+			tree.join(move(greater));
+		} else if (chooseInsert(op, period, random)) {
+			tree.insert(k);
+			expected.insert(k);
+		} else {
+			auto it = expected.find(k);
+			require(tree.deleteNode(k) == (it != expected.end()), "deleteNode found the wrong key");
+			if (it != expected.end()) {
+				expected.erase(it);
+			}
+		}
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::multiset");
+			require(equal(tree.begin(), tree.end(), expected.begin(), expected.end(),
+			              [](const pair<const int, RBNoValue> &a, int b) { return a.first == b; }),
+			        "contents differ from std::multiset");
+		}
+	}
+}
+
+// the std::map interface with OrderStats, plus the set operations
+static void stressRankedMap(const Options &options, mt19937_64 &random) {
+	RankedMap tree;
+	map<int, int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (op % 1009 == 0) {
+			// union with a small batch, then take some keys out again
+			vector<pair<int, int>> batch;
+			for (int i = 0; i < 16; i++) {
+				batch.emplace_back(anyKey(random), int(op));
+			}
+			tree.insertMany(batch.begin(), batch.end(), 2);
+			expected.insert(batch.begin(), batch.end());
+
+			RankedMap removed;
+			for (int i = 0; i < 16; i++) {
+				int r = anyKey(random);
+				removed.try_emplace(r, 0);
+				expected.erase(r);
+			}
+			tree.differenceWith(move(removed), 2);
+		} else if (chooseInsert(op, period, random)) {
+			bool added = tree.try_emplace(k, int(op)).second;
+			require(added == expected.emplace(k, int(op)).second, "try_emplace disagrees with std::map");
+		} else {
+			require(tree.erase(k) == expected.erase(k), "erase disagrees with std::map");
+		}
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::map");
+			require(equal(tree.begin(), tree.end(), expected.begin(), expected.end()),
+			        "contents differ from std::map");
+			size_t i = 0;
+			for (const auto &kv : expected) {
+				require(tree.select(i)->first == kv.first && tree.rank(kv.first) == i,
+				        "select or rank is wrong");
+				i++;
+			}
+		}
+	}
+}
+
+// insert and deleteNode while older snapshots must stay as they were
+static void stressPersistentTree(const Options &options, mt19937_64 &random) {
+	PersistentRBTree<int> tree;
+	multiset<int> expected;
+	deque<pair<PersistentRBTree<int>::Snapshot, multiset<int>>> snapshots; // the last few
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	auto matches = [](const auto &view, const multiset<int> &keys) {
+		auto it = keys.begin();
+		bool same = view.size() == keys.size();
+		view.forEach([&](int k) {
+			same = same && it != keys.end() && *it++ == k;
+		});
+		return same;
+	};
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (op % 499 == 0) {
+			snapshots.emplace_back(tree.snapshot(), expected);
+			if (snapshots.size() > 4) {
+				snapshots.pop_front();
+			}
+		}
+		if (chooseInsert(op, period, random)) {
+			tree.insert(k);
+			expected.insert(k);
+		} else {
+			auto it = expected.find(k);
+			require(tree.deleteNode(k) == (it != expected.end()), "deleteNode found the wrong key");
+			if (it != expected.end()) {
+				expected.erase(it);
+			}
+		}
+
+		if (op % 4096 == 0) {
+			require(matches(tree, expected), "contents differ from std::multiset");
+			for (const auto &saved : snapshots) {
+				require(matches(saved.first, saved.second), "a snapshot changed after it was taken");
+				require(PersistentRBTree<int>(saved.first).isValid(), "a snapshot is not a valid tree");
+			}
+		}
+	}
+}
+
+// insert and deleteNode with duplicate keys on the index-based tree,
+// whose fixDelete is a separate copy of RBTree's
+static void stressCompactTree(const Options &options, mt19937_64 &random) {
+	CompactRBTree tree;
+	multiset<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (chooseInsert(op, period, random)) {
+			tree.insert(k);
+			expected.insert(k);
+		} else {
+			auto it = expected.find(k);
+			require(tree.deleteNode(k) == (it != expected.end()), "deleteNode found the wrong key");
+			if (it != expected.end()) {
+				expected.erase(it);
+			}
+		}
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::multiset");
+			for (int key = 0; key < options.keys; key++) {
+				require(tree.contains(key) == (expected.count(key) != 0), "contains disagrees with std::multiset");
+			}
+		}
+	}
+}
+
+// insert and deleteNode with duplicate keys on the tree which keeps
+// its path on a stack instead of in parent pointers
+static void stressParentFreeTree(const Options &options, mt19937_64 &random) {
+	ParentFreeRBTree tree;
+	multiset<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (chooseInsert(op, period, random)) {
+			tree.insert(k);
+			expected.insert(k);
+		} else {
+			auto it = expected.find(k);
+			require(tree.deleteNode(k) == (it != expected.end()), "deleteNode found the wrong key");
+			if (it != expected.end()) {
+				expected.erase(it);
+			}
+		}
+		require(tree.isValid(), "ParentFreeRBTree invariant broken");
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::multiset");
+			for (int key = 0; key < options.keys; key++) {
+				require((tree.searchTree(key) != nullptr) == (expected.count(key) != 0),
+				        "searchTree disagrees with std::multiset");
+			}
+		}
+	}
+}
+
+// insert, deleteNode and erase, with the counts compared as well
+static void stressCountingTree(const Options &options, mt19937_64 &random) {
+	CountingRBTree<int> tree;
+	multiset<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (op % 613 == 0) {
+			require(tree.erase(k) == expected.erase(k), "erase disagrees with std::multiset");
+		} else if (chooseInsert(op, period, random)) {
+			require(tree.insert(k) == expected.count(k) + 1, "insert returned the wrong count");
+			expected.insert(k);
+		} else {
+			auto it = expected.find(k);
+			require(tree.deleteNode(k) == (it != expected.end()), "deleteNode found the wrong key");
+			if (it != expected.end()) {
+				expected.erase(it);
+			}
+		}
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::multiset");
+			size_t distinct = 0;
+			for (const auto &kv : tree) {
+				require(kv.second == expected.count(kv.first), "a count differs from std::multiset");
+				distinct++;
+			}
+			require(distinct == tree.distinctKeys(), "distinctKeys is wrong");
+			for (int key = 0; key < options.keys; key++) {
+				require(tree.contains(key) == (expected.count(key) != 0), "contains disagrees with std::multiset");
+			}
+		}
+	}
+}
+
+// insert and deleteNode with duplicate keys, which splits, borrows
+// and merges nodes as the tree grows and shrinks
+static void stressBPlusTree(const Options &options, mt19937_64 &random) {
+	BPlusTree tree;
+	multiset<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (chooseInsert(op, period, random)) {
+			tree.insert(k);
+			expected.insert(k);
+		} else {
+			auto it = expected.find(k);
+			require(tree.deleteNode(k) == (it != expected.end()), "deleteNode found the wrong key");
+			if (it != expected.end()) {
+				expected.erase(it);
+			}
+		}
+		require(tree.isValid(), "BPlusTree invariant broken");
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::multiset");
+			for (int key = 0; key < options.keys; key++) {
+				require(tree.contains(key) == (expected.count(key) != 0), "contains disagrees with std::multiset");
+			}
+		}
+	}
+}
+
+// insert, deleteNode and clear from one thread, with the lock-free
+// reads compared against std::set
+static void stressConcurrentTree(const Options &options, mt19937_64 &random) {
+	ConcurrentRBTree<int> tree;
+	set<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (size_t op = 0; op < options.ops; op++) {
+		currentOp = op;
+		int k = anyKey(random);
+		if (op % 10007 == 9999) {
+			tree.clear();
+			expected.clear();
+		} else if (chooseInsert(op, period, random)) {
+			require(tree.insert(k) == expected.insert(k).second, "insert disagrees with std::set");
+		} else {
+			require(tree.deleteNode(k) == (expected.erase(k) != 0), "deleteNode disagrees with std::set");
+		}
+		require(tree.contains(k) == (expected.count(k) != 0), "contains disagrees with std::set");
+
+		if (op % 4096 == 0) {
+			require(tree.size() == expected.size(), "size differs from std::set");
+			int low = 0, high = 0;
+			bool found = tree.minimum(low) && tree.maximum(high);
+			require(found == !expected.empty(), "minimum or maximum missed the keys");
+			require(!found || (low == *expected.begin() && high == *expected.rbegin()),
+			        "minimum or maximum differs from std::set");
+			for (int key = 0; key < options.keys; key++) {
+				require(tree.contains(key) == (expected.count(key) != 0), "contains disagrees with std::set");
+			}
+		}
+	}
+}
+
+// One writer inserting and deleting while readers look keys up
+// without the lock. Keys k % 3 == 0 are put in before the readers
+// start and never deleted, keys k % 3 == 2 are never put in, and the
+// writer churns the rest, so every read of the first two kinds has
+// one right answer however it races with the writer.
+static void stressConcurrentReaders(const Options &options, mt19937_64 &random) {
+	const unsigned READERS = 3;
+	ConcurrentRBTree<int> tree;
+	set<int> expected;
+	uniform_int_distribution<int> anyKey(0, options.keys - 1);
+	size_t period = 4 * size_t(options.keys);
+
+	for (int key = 0; key < options.keys; key += 3) {
+		tree.insert(key);
+		expected.insert(key);
+	}
+
+	atomic<bool> done{false};
+	atomic<const char *> broken{nullptr};
+	atomic<size_t> lookups{0};
+	vector<thread> readers;
+	for (unsigned r = 0; r < READERS; r++) {
+		readers.emplace_back([&, seed = random()] {
+			mt19937_64 own(seed);
+			uniform_int_distribution<int> readKey(0, options.keys - 1);
+			size_t reads = 0;
+			for (; !done.load(memory_order_relaxed) && broken.load(memory_order_relaxed) == nullptr; reads++) {
+				int k = readKey(own);
+				int low = -1;
+				if (k % 3 == 0 && !tree.contains(k)) {
+					broken = "a key which is always there was not found";
+				} else if (k % 3 == 2 && tree.contains(k)) {
+					broken = "a key which is never there was found";
+				} else if (!tree.minimum(low) || low != 0) {
+					broken = "minimum missed key 0, which is always there";
+				}
+			}
+			lookups += reads;
+		});
+	}
+
+	// the writer's own checks may throw, so the readers are stopped
+	// and joined before anything leaves this function
+	string failure;
+	try {
+		for (size_t op = 0; op < options.ops && broken.load() == nullptr; op++) {
+			currentOp = op;
+			int k = anyKey(random) / 3 * 3 + 1;
+			if (k >= options.keys) {
+				continue;
+			}
+			if (chooseInsert(op, period, random)) {
+				require(tree.insert(k) == expected.insert(k).second, "insert disagrees with std::set");
+			} else {
+				require(tree.deleteNode(k) == (expected.erase(k) != 0), "deleteNode disagrees with std::set");
+			}
+		}
+	} catch (const logic_error &error) {
+		failure = error.what();
+	}
+	done = true;
+	for (auto &t : readers) {
+		t.join();
+	}
+
+	require(failure.empty(), failure);
+	if (const char *what = broken.load()) {
+		throw logic_error(what);
+	}
+	require(tree.size() == expected.size(), "size differs from std::set");
+	cout << "Lookups during writes: " << lookups << ", of which fell back to the lock: " << tree.lockedReads()
+	     << endl;
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		string name = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+		if (name == "ops") {
+			options.ops = strtoull(value.c_str(), nullptr, 10);
+		} else if (name == "keys") {
+			options.keys = atoi(value.c_str());
+		} else if (name == "seed") {
+			options.seed = strtoul(value.c_str(), nullptr, 10);
+		} else {
+			cerr << "usage: " << argv[0] << " [ops=N] [keys=K] [seed=S]" << endl;
+			return 1;
+		}
+	}
+	if (options.keys < 1) {
+		cerr << "keys must be at least 1" << endl;
+		return 1;
+	}
+
+	cout << "seed=" << options.seed << " ops=" << options.ops << " keys=" << options.keys << endl;
+	const char *current = "";
+	try {
+		mt19937_64 random(options.seed);
+		current = "RBTree<int> insert/deleteNode/split/join";
+		stressMultiTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "RBTree<int, int, OrderStats> map interface and set operations";
+		stressRankedMap(options, random);
+		cout << current << ": ok" << endl;
+		current = "PersistentRBTree insert/deleteNode with snapshots";
+		stressPersistentTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "CompactRBTree insert/deleteNode";
+		stressCompactTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "ParentFreeRBTree insert/deleteNode";
+		stressParentFreeTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "CountingRBTree insert/deleteNode/erase";
+		stressCountingTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "BPlusTree insert/deleteNode";
+		stressBPlusTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "ConcurrentRBTree insert/deleteNode/clear";
+		stressConcurrentTree(options, random);
+		cout << current << ": ok" << endl;
+		current = "ConcurrentRBTree lock-free reads during writes";
+		stressConcurrentReaders(options, random);
+		cout << current << ": ok" << endl;
+	} catch (const logic_error &error) {
+		cerr << current << ": " << error.what() << " at op " << currentOp << " (seed=" << options.seed << ")" << endl;
+		return 1;
+	}
+	return 0;
+}